@@ -0,0 +1,112 @@
+/*arena.cpp*/
+
+//
+// Bump-pointer memory arena. See arena.h.
+//
+// Each block starts with a pointer to the block allocated before it,
+// so the arena is a list of blocks that arena_destroy() walks. Chunks
+// start at 64KB and double up to 4MB, so a big program needs only a
+// few dozen of them; a request larger than half a chunk gets a block
+// of its own, so the rest of the current chunk isn't wasted.
+//
+
+#include <cstdlib>
+#include <cstring>
+
+#include "arena.h"
+
+using namespace std;
+
+
+#define FIRST_CHUNK_SIZE (64 * 1024)
+#define MAX_CHUNK_SIZE   (4 * 1024 * 1024)
+#define BLOCK_HEADER     16  // link to the previous block, keeps the rest 16-byte aligned
+
+
+//
+// allocates a block with room for size bytes after its header:
+//
+static char* new_block(struct ARENA* arena, size_t size)
+{
+  char* block = (char*) malloc(BLOCK_HEADER + size);
+
+  *(void**) block = arena->blocks;
+  arena->blocks = block;
+
+  return block + BLOCK_HEADER;
+}
+
+
+//
+// arena_create
+//
+struct ARENA* arena_create(void)
+{
+  struct ARENA* arena = (struct ARENA*) malloc(sizeof(struct ARENA));
+
+  arena->free_space = NULL;
+  arena->free_bytes = 0;
+  arena->chunk_size = FIRST_CHUNK_SIZE;
+  arena->blocks = NULL;
+
+  return arena;
+}
+
+
+//
+// arena_destroy
+//
+void arena_destroy(struct ARENA* arena)
+{
+  void* block = arena->blocks;
+
+  while (block != NULL) {
+    void* prev = *(void**) block;
+    free(block);
+    block = prev;
+  }
+
+  free(arena);
+}
+
+
+//
+// arena_grow
+//
+void* arena_grow(struct ARENA* arena, size_t size)
+{
+  if (size > arena->chunk_size / 2)
+    return new_block(arena, size);
+
+  char* chunk = new_block(arena, arena->chunk_size);
+
+  arena->free_space = chunk + size;
+  arena->free_bytes = arena->chunk_size - size;
+
+  if (arena->chunk_size < MAX_CHUNK_SIZE)
+    arena->chunk_size *= 2;
+
+  return chunk;
+}
+
+
+//
+// arena_copy
+//
+char* arena_copy(struct ARENA* arena, const char* s, size_t length)
+{
+  char* copy;
+
+  if (length + 1 > arena->free_bytes)
+    copy = (char*) arena_grow(arena, length + 1);
+  else {
+    copy = arena->free_space;
+    arena->free_space += length + 1;
+    arena->free_bytes -= length + 1;
+  }
+
+  memcpy(copy, s, length);
+  copy[length] = '\0';
+
+  return copy;
+}
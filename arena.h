@@ -0,0 +1,82 @@
+/*arena.h*/
+
+//
+// Bump-pointer memory arena: many small allocations carved out of a
+// few large chunks, all freed at once when the arena is destroyed.
+// Nothing in an arena is freed (or moved) individually, so it suits
+// data that lives and dies together, like the tokens or the program
+// graph of one program.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+struct ARENA
+{
+  char*  free_space;   // in the current chunk
+  size_t free_bytes;
+  size_t chunk_size;   // of the next chunk, doubles up to a limit
+  void*  blocks;       // the last block, each links to the one before
+};
+
+
+//
+// Public functions:
+//
+
+//
+// arena_create
+//
+// Returns a new, empty arena; call arena_destroy() to free it and
+// everything allocated from it.
+//
+struct ARENA* arena_create(void);
+
+//
+// arena_destroy
+//
+// Frees the arena and everything allocated from it, a block at a
+// time (there are few blocks however much was allocated).
+//
+void arena_destroy(struct ARENA* arena);
+
+//
+// arena_grow
+//
+// Returns size bytes from a new block; arena_alloc() calls this when
+// the current chunk is full.
+//
+void* arena_grow(struct ARENA* arena, size_t size);
+
+//
+// arena_alloc
+//
+// Returns size bytes of uninitialized memory, 8-byte aligned (enough
+// for any of the program graph's structs), valid until the arena is
+// destroyed.
+//
+static inline void* arena_alloc(struct ARENA* arena, size_t size)
+{
+  size_t pad = (size_t) (-(uintptr_t) arena->free_space) & 7;
+
+  if (pad + size > arena->free_bytes)
+    return arena_grow(arena, size);
+
+  void* p = arena->free_space + pad;
+  arena->free_space += pad + size;
+  arena->free_bytes -= pad + size;
+
+  return p;
+}
+
+//
+// arena_copy
+//
+// Copies the length characters at s (which need not be NUL
+// terminated) into the arena, as a NUL-terminated string. Strings
+// aren't aligned, so they pack tightly.
+//
+char* arena_copy(struct ARENA* arena, const char* s, size_t length);
@@ -5,37 +5,49 @@
 //Implements the Debugger class, including the constructor, destructor, and the run function
 
 //Functionality:
-// -Breakpoints: Setting, removing, and clearing (remove all) breakpoints
+// -Breakpoints: Setting, removing, and clearing (remove all) breakpoints, optionally with a condition and/or ignore count
 // -Run: Running the program either until completion or until a breakpoint is hit
 // -Step: Stepping through statements one line at a time 
+// -Watch: Stopping as soon as a watched variable changes
+// -Reverse: Stepping back one stmt at a time, or back to the previous breakpoint, by undoing RAM writes from a journal
+// -Snapshots: Saving memory and the current position to a file, and resuming from it later
+// -Output: Sending the program's output to the console, a memory buffer or a file
 // -Extra: Provides commands to show commands, list breakpoints, show memory, print variables, show next execution line, and show program state 
 
 
 #include <iostream>
+#include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <deque>
 
 #include "debugger.h"
 
 using namespace std;
 
-Debugger::Debugger(struct STMT* program) 
-  : state("Loaded"), head(program), currentStmt(program), memory(ram_init()), second_time_breakpoint(false) //initialize data members 
-{   
-    //Responsible for: init next to next node of head, filling up the lines set with programgraph lines, and breaking connection between head and next node
-    next = getNextNode(head); 
-
-    while (head!=nullptr) {
-        lines.insert(head->line); 
-        head = next; 
-        next = getNextNode(next);
-    } //fill up lines set
+#define DEFAULT_JOURNAL_MB 64 //journal cap unless changed with the journal command
 
-    head = currentStmt; //reset head
-    next = getNextNode(head); //reset next (next node of head)
-    breakGraph(head); 
+Debugger::Debugger(struct STMT* program, struct VM_PROGRAM* vm, bool batch, struct OPTIMIZED_PROGRAM* optimized, struct VM_PROGRAM* vmOptimized) 
+  : state("Loaded"), head(program), currentStmt(program), memory(ram_init()), vm(vm), optimized(optimized), vmOptimized(vmOptimized), batch(batch), second_time_breakpoint(false), watchTriggered(false), indexedCells(0), journal(nullptr), output(nullptr) //initialize data members 
+{   
+    //Responsible for: building the line index over the whole programgraph (the graph itself is only ever read, never cut)
+    buildLineIndex(); 
+    lineFlags.assign(lineIndex.size(), 0); //one set of flags (breakpoint, watch) per line of the program
+    if (optimized == nullptr) {
+        setJournalLimit((size_t) DEFAULT_JOURNAL_MB * 1024 * 1024); //record from the start, so bs/rr can go back to it
+    } //(optimized runs need the journal off, so it starts off and the journal command turns it on)
+    setOutput(SINK_STDOUT, ""); //program output goes to the console until changed with the out command
 }
 
 Debugger::~Debugger() //Called automatically when debugger object goes out of scope (end of main() function)
 {
+    for (auto& entry : breakConditions) {
+        destroyCondition(entry.second); 
+    } //Frees the parsed breakpoint conditions
+    if (journal != nullptr) {
+        journal_destroy(journal); 
+    }
+    sink_destroy(output); //Flushes the program output that's still buffered
     ram_destroy(memory);  //Frees the RAM memory (programgraph cleared in main.cpp)
 }
 
@@ -45,35 +57,49 @@ void Debugger::run()
   //Gather cmd from user input 
   string cmd;  
   while (true) {
-    //List out all of the commands to the user 
-    cout << endl; 
-    cout << "Enter a command, type h for help. Type r to run. > " <<endl; 
-    cin >> cmd; 
+    //List out all of the commands to the user (no prompt in batch mode, the commands come from a script)
+    if (!batch) {
+      cout << "\n"; 
+      cout << "Enter a command, type h for help. Type r to run. > \n"; 
+    }
+    if (!(cin >> cmd)) {
+      break; //end of input (e.g. the end of the script) -> same as q
+    }
 
     if (cmd=="h") {
-      cout << "Available commands:"<<endl;
-      cout << "r -> Run the program / continue from a breakpoint"<<endl; 
-      cout << "s -> Step to next stmt by executing current stmt" <<endl; 
-      cout << "b n -> Breakpoint at line n"<<endl; 
-      cout << "rb n -> Remove breakpoint at line n"<< endl; 
-      cout << "lb -> List all breakpoints" << endl; 
-      cout << "cb -> Clear all breakpoints" <<endl; 
-      cout << "p varname -> Print variable"<<endl; 
-      cout << "sm -> Show memory contents" <<endl; 
-      cout << "ss -> Show state of debugger"<<endl; 
-      cout << "w -> What line are we on?"<<endl; 
-      cout << "q -> Quit the debugger"<<endl; 
+      cout << "Available commands:\n";
+      cout << "r -> Run the program / continue from a breakpoint\n"; 
+      cout << "s -> Step to next stmt by executing current stmt\n"; 
+      cout << "bs -> Step back: undo the last stmt executed\n"; 
+      cout << "rr -> Run backwards to the previous breakpoint\n"; 
+      cout << "journal n -> Keep at most n MB of history for bs/rr (0 turns it off)\n"; 
+      cout << "save file -> Save memory and the current line to a file\n"; 
+      cout << "load file -> Resume from a file written by save\n"; 
+      cout << "out stdout|memory|file name -> Send the program's output to the console (default), memory, or a file\n"; 
+      cout << "po -> Print (and clear) the program output collected in memory\n"; 
+      cout << "b n -> Breakpoint at line n\n"; 
+      cout << "b n if expr -> Breakpoint at line n, only stops when expr is true\n"; 
+      cout << "b n after k -> Breakpoint at line n, ignores the first k times it's reached (can be combined: b n after k if expr)\n"; 
+      cout << "rb n -> Remove breakpoint at line n\n"; 
+      cout << "lb -> List all breakpoints\n"; 
+      cout << "watch x -> Stop as soon as variable x changes\n"; 
+      cout << "rw x -> Remove the watch on variable x\n"; 
+      cout << "cb -> Clear all breakpoints\n"; 
+      cout << "p varname -> Print variable\n"; 
+      cout << "sm -> Show memory contents\n"; 
+      cout << "ss -> Show state of debugger\n"; 
+      cout << "w -> What line are we on?\n"; 
+      cout << "q -> Quit the debugger\n"; 
     }
 
     else if (cmd=="q") {
       //return -> breaks out of the entire user input loop 
-      repairGraph(currentStmt, next); 
       break; 
     }
 
     else if (cmd=="ss") {
       //State is kept in "state" data member, print that out 
-      cout << state <<endl; 
+      cout << state << "\n"; 
     }
 
     else if (cmd=="sm") {
@@ -87,212 +113,957 @@ void Debugger::run()
       cin>>varname_str; 
       const char* varname = varname_str.c_str(); 
 
-      //Call ram_read_cell_by_name
-      struct RAM_VALUE* cell = ram_read_cell_by_name(memory, (char*)varname); 
+      //Look up the address through the hashed index (instead of ram_read_cell_by_name's linear scan over the cells),
+      //then borrow the value in place -> no copy to allocate and free just to print it
+      int addr = findAddr(varname_str); 
+      const struct RAM_VALUE* cell = ram_peek_by_addr(memory, addr); 
 
       //Print "varname (type): value" according to ram type, handle case where cell==NULL (no such variable) 
-      if (cell==NULL) {
-        cout << "no such variable" <<endl; 
-      } else {
-        int value_type = cell->value_type; 
-        cout << varname << " ("; 
-        if (value_type==RAM_TYPE_REAL) {
-          cout << "real): " << cell->types.d << " " <<endl; 
-        } else if (value_type==RAM_TYPE_STR) {
-          cout << "str): " << cell->types.s << " " <<endl; 
-        } else if (value_type == RAM_TYPE_INT) {
-          cout << "int): " << cell->types.i << " " <<endl; 
-        } else if (value_type == RAM_TYPE_PTR) {
-          cout << "ptr): " << cell->types.i << " " <<endl; 
-        } else if (value_type == RAM_TYPE_BOOLEAN) {
-          cout << "bool): " << cell->types.i << " " <<endl; 
-        } else {
-          cout << "none): " << "null" << " " <<endl; 
-        }
-        ram_free_value(cell); //Free the RAM_VALUE* 
-      }
+      printValue(varname, cell); 
     }
 
     else if (cmd == "r") {
         //Run command: perform step operation UNTIL currentStmt is either null or a breakpoint is reached
         if (state=="Completed") {
-            cout << "program has completed" <<endl; 
+            cout << "program has completed\n"; 
             continue; 
         }
-        int start = currentStmt->line; 
-        step(); //Always begin with a step (moves currentStmt to the next of last, lets below loop run)
-        while (currentStmt!=nullptr && breakpoints.find(currentStmt->line)==breakpoints.end()) {
-            step(); 
-            if (state=="Completed") {
+        bool hitBefore = second_time_breakpoint; 
+        step(); //Always begin with a step (moves currentStmt to the next of last, lets below run)
+        if ((!hitBefore && second_time_breakpoint) || watchTriggered) {
+            continue; //the step only announced a breakpoint (nothing was executed), or changed a watched variable
+        }
+        //Then run natively (one execute call, not one per stmt) until currentStmt is on a breakpoint line whose condition holds, or the program is done
+        //(a breakpoint line whose condition is false is executed and the run continues from there)
+        bool conditionChecked = false; 
+        while (currentStmt!=nullptr && !shouldBreak(currentStmt->line, conditionChecked)) {
+            if (isWatchLine(currentStmt->line)) {
+                executeOneLine(); //assigns a watched variable, executeOneLine checks whether it changed
+                conditionChecked = false; 
+            } else {
+                runToBreakpoint(); 
+                conditionChecked = (vm != nullptr); //the VM evaluates compiled conditions itself and only stops if they hold
+            }
+            if (watchTriggered) {
                 break; 
             }
         }
-        //Note: If we were stopped by a breakpoint, we have to still perform step on that breakpoint line (this is the "first time breakpoint reached" case)
+        //Note: If we were stopped by a breakpoint, we still have to announce it (this is the "first time breakpoint reached" case)
         //This will print out that a breakpoint was hit on {line} and then change the second_time_breakpoint to true so that the next execution actually
         //runs that breakpoint line
         if (currentStmt==nullptr) {
             state="Completed"; 
             continue; 
         }
-        if (breakpoints.find(currentStmt->line)!=breakpoints.end() && (currentStmt->line!=start)) {
-            step(); //Perform one more step to load state into second time hitting breakpoint 
+        if (!watchTriggered) {
+            announceBreakpoint(); 
         }
     } 
 
     else if (cmd=="s") {
         //Step command: call helper function step() defined below
         if (state=="Completed") {
-            cout << "program has completed" <<endl; 
+            cout << "program has completed\n"; 
         }
         step(); 
     }
         
+    else if (cmd=="bs") {
+        //Step back command: undo one stmt, the stmt becomes the next one to execute again
+        if (!stepBack()) {
+            cout << (journal == nullptr ? "journal is off" : "no earlier history") << "\n"; 
+            continue; 
+        }
+        cout << "line " << currentStmt->line << "\n"; 
+        printStmt(currentStmt); 
+    }
+
+    else if (cmd=="rr") {
+        //Reverse run command: undo stmts until currentStmt is on a breakpoint line whose condition holds
+        //(ignore counts only apply when running forward, so they aren't used up here)
+        bool moved = false; 
+        bool found = false; 
+        while (stepBack()) {
+            moved = true; 
+            if (isBreakLine(currentStmt->line) && conditionHolds(currentStmt->line)) {
+                found = true; 
+                break; 
+            }
+        }
+        if (found) {
+            announceBreakpoint(); 
+        } else if (moved) {
+            cout << "reached the start of the history at line " << currentStmt->line << "\n"; 
+            printStmt(currentStmt); 
+        } else {
+            cout << (journal == nullptr ? "journal is off" : "no earlier history") << "\n"; 
+        }
+    }
+
+    else if (cmd=="journal") {
+        long mb; 
+        if (!(cin >> mb) || mb < 0) {
+            cin.clear(); 
+            cout << "invalid journal size\n"; 
+            continue; 
+        }
+        setJournalLimit((size_t) mb * 1024 * 1024); 
+        if (mb == 0) {
+            cout << "journal off\n"; 
+        } else {
+            cout << "journal limit set to " << mb << " MB\n"; 
+        }
+    }
+
+    else if (cmd=="save") {
+        string filename; 
+        cin >> filename; 
+        saveSnapshot(filename); 
+    }
+
+    else if (cmd=="load") {
+        string filename; 
+        cin >> filename; 
+        loadSnapshot(filename); 
+    }
+
+    else if (cmd=="out") {
+        string target; 
+        cin >> target; 
+        if (target == "stdout") {
+            setOutput(SINK_STDOUT, ""); 
+            cout << "program output to the console\n"; 
+        } else if (target == "memory") {
+            setOutput(SINK_MEMORY, ""); 
+            cout << "program output to memory, po prints it\n"; 
+        } else if (target == "file") {
+            string filename; 
+            cin >> filename; 
+            if (setOutput(SINK_FILE, filename)) {
+                cout << "program output to " << filename << "\n"; 
+            } else {
+                cout << "unable to open " << filename << "\n"; 
+            }
+        } else {
+            cout << "unknown output: " << target << "\n"; 
+        }
+    }
+
+    else if (cmd=="po") {
+        //Print what the program output since the last po, between markers so it can't be mistaken for debugger output
+        size_t length; 
+        const char* text = sink_contents(output, &length); 
+        if (text == nullptr) {
+            cout << "program output isn't being collected (out memory)\n"; 
+            continue; 
+        }
+        cout << "**program output (" << length << " bytes)**\n"; 
+        cout.write(text, length); 
+        if (length > 0 && text[length - 1] != '\n') {
+            cout << "\n"; //e.g. an input() prompt, keep the marker on its own line
+        }
+        cout << "**end program output**\n"; 
+        sink_clear(output); 
+    }
+
     else if (cmd=="b") {
         int n; 
         cin >> n; 
-        //Case: line isn't found in the programgraph (utilize lines set)
-        if (lines.find(n)==lines.end()) {
-            cout << "no such line" <<endl; 
+        string options; 
+        getline(cin, options); //optional "after k" and/or "if expr" on the rest of the line
+
+        //Case: line isn't found in the programgraph (utilize line index, covers loop bodies too)
+        if (n < 0 || n >= (int) lineIndex.size() || lineIndex[n] == nullptr) {
+            cout << "no such line\n"; 
             continue; 
         }
         //Case: breakpoint already exists
-        if (breakpoints.find(n)!=breakpoints.end()) {
-            cout << "breakpoint already set" <<endl; 
+        if (isBreakLine(n)) {
+            cout << "breakpoint already set\n"; 
             continue; 
         }
 
-        //Breakpoint management revolves around inserting and deleting from breakpoints set
-        breakpoints.insert(n); 
-        cout << "breakpoint set" << endl;
+        //Case: condition or ignore count given, parse it once now (executors only see the line flag, the condition is checked when the line is reached)
+        BreakCondition condition; 
+        if (!parseCondition(n, options, condition)) {
+            continue; 
+        }
+        if (condition.expr != nullptr || condition.ignore > 0) {
+            breakConditions[n] = condition; 
+        }
+
+        //Breakpoint management revolves around setting and clearing flags in the breakpoint bitmap (the same bitmap the executors check)
+        lineFlags[n] |= BREAK_FLAG; 
+        cout << "breakpoint set\n";
     } 
     
     else if (cmd == "rb") {
         int n;
         cin >> n;
-        //Removing means to just remove from the breakpoint set
-        if (breakpoints.find(n)!=breakpoints.end()) {
-            breakpoints.erase(n); 
-            cout << "breakpoint removed" << endl; 
+        //Removing means to just clear the line's flag
+        if (isBreakLine(n)) {
+            lineFlags[n] &= ~BREAK_FLAG; 
+            removeCondition(n); 
+            cout << "breakpoint removed\n"; 
         } else {
-            cout << "no such breakpoint" << endl; 
+            cout << "no such breakpoint\n"; 
         } //Case: no such breakpoint
     }
     else if (cmd == "cb") {
-        // Clear the breakpoints set 
-        breakpoints.clear(); 
-        cout << "breakpoints cleared" << endl;
+        // Clear the breakpoint bitmap 
+        for (unsigned char& flags : lineFlags) {
+            flags &= ~BREAK_FLAG; 
+        }
+        for (auto& entry : breakConditions) {
+            if (vm != nullptr) {
+                vm_set_condition(vm, entry.first, nullptr); 
+            }
+            destroyCondition(entry.second); 
+        }
+        breakConditions.clear(); 
+        cout << "breakpoints cleared\n";
+    }
+
+    else if (cmd == "watch") {
+        string varname; 
+        cin >> varname; 
+        //Case: already watching this variable
+        if (findWatch(varname) != watches.end()) {
+            cout << "already watching " << varname << "\n"; 
+            continue; 
+        }
+
+        //Remember the current value (the variable may not exist yet), changes are detected against it
+        Watch watch; 
+        watch.name = varname; 
+        saveWatchValue(watch); 
+        watches.push_back(watch); 
+        updateWatchFlags(varname, true); 
+        cout << "watching " << varname << "\n"; 
+    }
+
+    else if (cmd == "rw") {
+        string varname; 
+        cin >> varname; 
+        auto found = findWatch(varname); 
+        if (found != watches.end()) {
+            watches.erase(found); 
+            updateWatchFlags(varname, false); 
+            cout << "watch removed\n"; 
+        } else {
+            cout << "no such watch\n"; 
+        } //Case: no such watch
     }
 
     else if (cmd == "lb") {
-        //breakpoints set already has the line numbers in sorted order, so we take advantage of that 
-        if (breakpoints.empty()) {
-            cout << "no breakpoints" <<endl; 
+        //the bitmap is indexed by line number, so scanning it lists the breakpoints in sorted order 
+        if (none_of(lineFlags.begin(), lineFlags.end(), [](unsigned char flags) { return (flags & BREAK_FLAG) != 0; })) {
+            cout << "no breakpoints\n"; 
         } else {
-            //loop through breakpoints (using iterator which is also native to sets) and print line numbers 
+            //loop through the lines and print the flagged line numbers 
             cout << "breakpoints on lines: "; 
-            for (auto iterator = breakpoints.begin(); iterator != breakpoints.end(); ++iterator) { //++ operator for iterator to move one to right
-                cout << *iterator << " "; 
+            for (int line = 0; line < (int) lineFlags.size(); line++) {
+                if (isBreakLine(line)) {
+                    cout << line << " "; 
+                    auto found = breakConditions.find(line); 
+                    if (found != breakConditions.end()) {
+                        cout << "(" << found->second.text << ") "; 
+                    }
+                }
             }
-            cout << endl; 
+            cout << "\n"; 
         }
     }
 
     else if (cmd == "w") {
         if (state == "Completed") {
-            cout << "completed execution" << endl;
+            cout << "completed execution\n";
         } 
         else if (state == "Loaded") {
-            cout << "line "<<head->line << endl;
-            programgraph_print(head); //This will always be the head line (head always ref first node, unchanged)
+            cout << "line "<<head->line << "\n";
+            printStmt(head); //This will always be the head line (head always ref first node, unchanged)
         } 
         //The line that's going to run next is the line that's at our currentStmt right now 
         else if (state == "Running") {
-            cout << "line " << currentStmt->line << endl;
-            programgraph_print(currentStmt); 
+            cout << "line " << currentStmt->line << "\n";
+            printStmt(currentStmt); 
         }
     }
     else { //Case: unknown user command 
-        cout << "unknown command" <<endl; 
+        cout << "unknown command\n"; 
     }
   }
 }
 
 
 void Debugger::step() {
+    if (currentStmt == nullptr) {
+        return; //nothing left to execute (program completed or stopped on an error)
+    }
+
     if (state=="Loaded") {
         state="Running"; 
     } //state management 
 
-    if (breakpoints.find(currentStmt->line)!=breakpoints.end()) { //CURRENT STATEMENT IS A BREAKPOINT
-        if (!second_time_breakpoint) { //FIRST TIME HITTING BREAKPOINT
-            cout << "hit breakpoint at line " << currentStmt->line << endl; 
-            programgraph_print(currentStmt); 
-            second_time_breakpoint = true; //flip the breakpoint status flag
-        } else { //SECOND TIME HITTING BREAKPOINT, EXECUTE ONE LINE
-            second_time_breakpoint = false; //flip the breakpoint status flag
-            executeOneLine(); 
-        }
+    if (second_time_breakpoint && isBreakLine(currentStmt->line)) { //SECOND TIME HITTING BREAKPOINT, EXECUTE ONE LINE
+        second_time_breakpoint = false; //flip the breakpoint status flag
+        executeOneLine(); 
+    } else if (shouldBreak(currentStmt->line)) { //FIRST TIME HITTING BREAKPOINT (and its condition holds)
+        announceBreakpoint(); 
     } else { //NOT A BREAKPOINT, EXECUTE ONE LINE
+        second_time_breakpoint = false; //(the breakpoint may have been removed after it was hit)
         executeOneLine(); 
     }
 }
 
+void Debugger::announceBreakpoint() {
+    cout << "hit breakpoint at line " << currentStmt->line << "\n"; 
+    printStmt(currentStmt); 
+    second_time_breakpoint = true; //flip the breakpoint status flag
+}
+
 void Debugger::executeOneLine() {
-    ExecuteResult result = execute(currentStmt, memory); 
-    //currentStmt and next is severed right now, so execute will only execute currentStmt as desired
+    //Both engines run exactly one stmt (loop bodies included) and report the next one -> currentStmt is a cursor, the graph is never modified
+    watchTriggered = false; 
+    ExecuteResult result; 
+    sink_begin(output); //the program's output goes through the sink while it runs
+    if (vm != nullptr) {
+        result = vm_step(vm, memory, currentStmt, &currentStmt); 
+    } else {
+        result = execute_steps(currentStmt, memory, 1, journal, &currentStmt); 
+    }
+    sink_end(output); //flush point: execution stopped
+    if (!watches.empty()) {
+        checkWatches(result.LastStmt); 
+    }
 
-    //Handle consequences: repairGraph and then move current to next and next to its next and then break graph from that state (each prepares next step command)
-    if (result.Success==false) {
+    if (result.Success==false || currentStmt == nullptr) {
         state="Completed"; 
-        repairGraph(currentStmt, next); 
-    } 
-    repairGraph(currentStmt, next); 
-    currentStmt = next; 
-    next = getNextNode(next); 
-    if (currentStmt == nullptr) {
+        currentStmt = nullptr; //execution stops at an error, same as running without the debugger
+    }
+}
+
+void Debugger::runToBreakpoint() {
+    //Both engines check the line flags at each stmt boundary (loop bodies included) and stop before a flagged line
+    //(the VM also stops right after a write to a watched variable)
+    watchTriggered = false; 
+    ExecuteResult result; 
+    if (canRunOptimized()) {
+        runOptimized(); 
+        return; 
+    }
+    sink_begin(output); 
+    if (vm != nullptr) {
+        result = vm_continue(vm, memory, currentStmt, lineFlags.data(), (int) lineFlags.size(), &currentStmt); 
+    } else {
+        result = execute_continue(currentStmt, memory, lineFlags.data(), (int) lineFlags.size(), journal, &currentStmt); 
+    }
+    sink_end(output); //flush point: breakpoint, watch or end of the program
+    if (!watches.empty()) {
+        checkWatches(result.LastStmt); 
+    }
+
+    if (result.Success==false || currentStmt == nullptr) {
         state="Completed"; 
+        currentStmt = nullptr; 
+    }
+}
+
+bool Debugger::canRunOptimized() {
+    //Nothing can stop the run: no breakpoints or watches to stop at, no journal that needs every stmt the original program executes
+    return optimized != nullptr && journal == nullptr && watches.empty() && 
+           none_of(lineFlags.begin(), lineFlags.end(), [](unsigned char flags) { return flags != 0; }); 
+}
+
+void Debugger::runOptimized() {
+    //Continue in the optimized programgraph from the copy of currentStmt; only an error stops it before the end, and that
+    //stmt (the one an error stops at) is mapped back to the original programgraph
+    ExecuteResult result; 
+    STMT* next = nullptr; 
+    sink_begin(output); 
+    if (vmOptimized != nullptr) {
+        result = vm_continue(vmOptimized, memory, optimize_entry(optimized, currentStmt), lineFlags.data(), (int) lineFlags.size(), &next); 
     } else {
-        breakGraph(currentStmt); 
+        result = execute_continue(optimize_entry(optimized, currentStmt), memory, lineFlags.data(), (int) lineFlags.size(), nullptr, &next); 
+    }
+    sink_end(output); 
+    currentStmt = optimize_original(optimized, next); 
+
+    if (result.Success==false || currentStmt == nullptr) {
+        state="Completed"; 
+        currentStmt = nullptr; 
     }
 }
 
+//Fills lineIndex: line -> stmt, for every line that has a stmt
+void Debugger::buildLineIndex() {
+    //Walk every stmt reachable from head (loop bodies and if paths included) with an explicit stack, recording each line's stmt
+    vector<STMT*> pending; 
+    pending.push_back(head); 
+
+    while (!pending.empty()) {
+        STMT* node = pending.back(); 
+        pending.pop_back(); 
+        if (node == nullptr) {
+            continue; 
+        }
+
+        if (node->line >= (int) lineIndex.size()) {
+            lineIndex.resize(node->line + 1); 
+        }
+        if (lineIndex[node->line] != nullptr) {
+            continue; //already indexed (loop bodies link back to their loop)
+        }
 
-void Debugger::breakGraph(STMT* node) {
-    if (node!=nullptr) {
+        lineIndex[node->line] = node; 
         if (node->stmt_type == STMT_ASSIGNMENT) {
-            node->types.assignment->next_stmt = nullptr; 
+            pending.push_back(node->types.assignment->next_stmt); 
         } else if (node->stmt_type == STMT_FUNCTION_CALL) {
-            node->types.function_call->next_stmt = nullptr; 
+            pending.push_back(node->types.function_call->next_stmt); 
         } else if (node->stmt_type == STMT_PASS) {
-            node->types.pass->next_stmt = nullptr; 
+            pending.push_back(node->types.pass->next_stmt); 
+        } else if (node->stmt_type == STMT_WHILE_LOOP) {
+            pending.push_back(node->types.while_loop->next_stmt); 
+            pending.push_back(node->types.while_loop->loop_body); 
+        } else if (node->stmt_type == STMT_IF_THEN_ELSE) {
+            pending.push_back(node->types.if_then_else->false_path); 
+            pending.push_back(node->types.if_then_else->true_path); 
         }
-    } //Helper function: break graph at node -> node's next
+    }
+}
+
+
+//Copies of the stmts of a loop (the loop itself, its body and any loops in it), linked to each other
+//instead of to the originals, so the loop prints without whatever follows it
+struct LoopCopy {
+    deque<STMT> stmts; 
+    deque<struct STMT_ASSIGNMENT> assignments; 
+    deque<struct STMT_FUNCTION_CALL> function_calls; 
+    deque<struct STMT_PASS> passes; 
+    deque<struct STMT_WHILE_LOOP> while_loops; 
+    unordered_map<STMT*, STMT*> copies; //Original -> copy
+};
+
+static STMT* copyOf(LoopCopy& loop, STMT* node) {
+    auto found = loop.copies.find(node); 
+    return (found == loop.copies.end()) ? nullptr : found->second; 
 }
 
-void Debugger::repairGraph(STMT* node, STMT* next) {
-    if (node != nullptr) {  // Ensure targetStmt is valid
+//Copy loop and everything reachable from its body (loop bodies link back to their loop, so that's all inside it), with its own next cut
+static STMT* copyLoop(LoopCopy& loop, STMT* head) {
+    vector<STMT*> pending; 
+    pending.push_back(head); 
+
+    while (!pending.empty()) {
+        STMT* node = pending.back(); 
+        pending.pop_back(); 
+        if (node == nullptr || loop.copies.count(node) != 0) {
+            continue; 
+        }
+
+        loop.stmts.push_back(*node); 
+        loop.copies[node] = &loop.stmts.back(); 
         if (node->stmt_type == STMT_ASSIGNMENT) {
-            node->types.assignment->next_stmt = next;
+            pending.push_back(node->types.assignment->next_stmt); 
         } else if (node->stmt_type == STMT_FUNCTION_CALL) {
-            node->types.function_call->next_stmt = next;
+            pending.push_back(node->types.function_call->next_stmt); 
         } else if (node->stmt_type == STMT_PASS) {
-            node->types.pass->next_stmt = next;
+            pending.push_back(node->types.pass->next_stmt); 
+        } else if (node->stmt_type == STMT_WHILE_LOOP) {
+            if (node != head) {
+                pending.push_back(node->types.while_loop->next_stmt); 
+            }
+            pending.push_back(node->types.while_loop->loop_body); 
         }
-    } //Helper function: set node's next to input next node
-}
+    }
 
-STMT* Debugger::getNextNode(STMT* node) {
-    STMT* next = nullptr; 
-    if (node != nullptr) {  // Ensure targetStmt is valid
+    //Now that every stmt has its copy, point the copies at each other
+    for (auto& entry : loop.copies) {
+        STMT* node = entry.first; 
+        STMT* copy = entry.second; 
         if (node->stmt_type == STMT_ASSIGNMENT) {
-            next = node->types.assignment->next_stmt; 
+            loop.assignments.push_back(*node->types.assignment); 
+            loop.assignments.back().next_stmt = copyOf(loop, node->types.assignment->next_stmt); 
+            copy->types.assignment = &loop.assignments.back(); 
         } else if (node->stmt_type == STMT_FUNCTION_CALL) {
-            next= node->types.function_call->next_stmt; 
+            loop.function_calls.push_back(*node->types.function_call); 
+            loop.function_calls.back().next_stmt = copyOf(loop, node->types.function_call->next_stmt); 
+            copy->types.function_call = &loop.function_calls.back(); 
         } else if (node->stmt_type == STMT_PASS) {
-            next= node->types.pass->next_stmt; 
+            loop.passes.push_back(*node->types.pass); 
+            loop.passes.back().next_stmt = copyOf(loop, node->types.pass->next_stmt); 
+            copy->types.pass = &loop.passes.back(); 
+        } else if (node->stmt_type == STMT_WHILE_LOOP) {
+            loop.while_loops.push_back(*node->types.while_loop); 
+            loop.while_loops.back().loop_body = copyOf(loop, node->types.while_loop->loop_body); 
+            loop.while_loops.back().next_stmt = (node == head) ? nullptr : copyOf(loop, node->types.while_loop->next_stmt); 
+            copy->types.while_loop = &loop.while_loops.back(); 
         }
+    }
+    return copyOf(loop, head); 
+}
+
+void Debugger::printStmt(STMT* node) {
+    //programgraph_print prints everything reachable from node, so print a copy of node whose next is null
+    //(for a while loop, a copy of the whole loop, since its body has to find its way back to the copied loop node)
+    if (node->stmt_type == STMT_WHILE_LOOP) {
+        LoopCopy loop; 
+        programgraph_print(copyLoop(loop, node)); 
+        return; 
+    }
+
+    STMT copy = *node; 
+    struct STMT_ASSIGNMENT assignment; 
+    struct STMT_FUNCTION_CALL function_call; 
+    struct STMT_PASS pass; 
+
+    if (node->stmt_type == STMT_ASSIGNMENT) {
+        assignment = *node->types.assignment; 
+        assignment.next_stmt = nullptr; 
+        copy.types.assignment = &assignment; 
+    } else if (node->stmt_type == STMT_FUNCTION_CALL) {
+        function_call = *node->types.function_call; 
+        function_call.next_stmt = nullptr; 
+        copy.types.function_call = &function_call; 
+    } else if (node->stmt_type == STMT_PASS) {
+        pass = *node->types.pass; 
+        pass.next_stmt = nullptr; 
+        copy.types.pass = &pass; 
     } 
-    return next; //Helper function: get input node's next node (may be nullptr!)
+    programgraph_print(&copy); 
+}
+
+//O(1) name -> address lookup (-1 if no such variable)
+int Debugger::findAddr(const string& varname) {
+    //Cells are only ever appended to RAM and never move, so we just index whatever was written since the last lookup
+    indexNewCells(); 
+
+    auto found = addrIndex.find(varname); 
+    if (found == addrIndex.end()) {
+        return -1; 
+    }
+    return found->second; 
+}
+
+//Is there a breakpoint on the line? One bounds check and one load, lines past the bitmap can't have breakpoints
+bool Debugger::isBreakLine(int line) {
+    return line < (int) lineFlags.size() && (lineFlags[line] & BREAK_FLAG) != 0; 
+}
+
+//Same as isBreakLine, for stmts that assign a watched variable
+bool Debugger::isWatchLine(int line) {
+    return line < (int) lineFlags.size() && (lineFlags[line] & WATCH_FLAG) != 0; 
+}
+
+//Decides whether reaching this line stops execution
+bool Debugger::shouldBreak(int line, bool conditionChecked) {
+    if (!isBreakLine(line)) {
+        return false; 
+    }
+    auto found = breakConditions.find(line); 
+    if (found == breakConditions.end()) {
+        return true; //plain breakpoint
+    }
+
+    //Conditional breakpoint: evaluate against the live memory (unless the VM just did)
+    BreakCondition& condition = found->second; 
+    if (!(conditionChecked && condition.compiled) && !conditionHolds(line)) {
+        return false; 
+    }
+    if (condition.ignore > 0) {
+        condition.ignore--; 
+        return false; 
+    }
+    return true; 
+}
+
+//The condition part of shouldBreak
+bool Debugger::conditionHolds(int line) {
+    auto found = breakConditions.find(line); 
+    if (found == breakConditions.end() || found->second.expr == nullptr) {
+        return true; 
+    }
+
+    //Evaluate in the context of the stmt on this line (so errors report this line)
+    RAM_VALUE* value = execute_expr(lineIndex[line], memory, found->second.expr); 
+    if (value == nullptr) {
+        return true; //error msg already output, stop so it can be looked at
+    }
+    bool holds = (value->types.i != 0); //same truth test as a while loop condition
+    ram_free_value(value); 
+    return holds; 
 }
 
+//Parse "[after k] [if expr]", false (msg already output) if invalid
+bool Debugger::parseCondition(int line, const string& options, BreakCondition& condition) {
+    istringstream input(options); 
+    string word; 
+    input >> word; 
+
+    if (word == "after") {
+        if (!(input >> condition.ignore) || condition.ignore < 0) {
+            cout << "invalid ignore count\n"; 
+            return false; 
+        }
+        condition.text = "after " + to_string(condition.ignore); 
+        word = ""; 
+        input >> word; 
+    }
+    if (word == "if") {
+        string expr; 
+        getline(input, expr); 
+
+        //Reuse the nuPython parser, which builds the graph: "x = <expr>" builds an assignment whose rhs is the EXPR we want
+        string program = "x = " + expr + "\n"; 
+        condition.graph = syntax_parse(program.c_str(), program.size()); 
+        STMT* stmt = (condition.graph != nullptr) ? condition.graph->program : nullptr; 
+        if (stmt != nullptr && stmt->stmt_type == STMT_ASSIGNMENT && stmt->types.assignment->next_stmt == nullptr 
+            && stmt->types.assignment->rhs->value_type == VALUE_EXPR) {
+            condition.expr = stmt->types.assignment->rhs->types.expr; 
+        }
+
+        //Only what execute_expr supports: elements (no unary -x, &x, *x) combined with an operator other than is/in
+        EXPR* parsed = condition.expr; 
+        if (parsed == nullptr || parsed->lhs->expr_type != UNARY_ELEMENT || (parsed->isBinaryExpr && (parsed->rhs->expr_type != UNARY_ELEMENT 
+            || parsed->operator_type == OPERATOR_IS || parsed->operator_type == OPERATOR_IN))) {
+            cout << "invalid breakpoint condition\n"; //(function calls like input() aren't allowed either)
+            destroyCondition(condition); 
+            return false; 
+        }
+        condition.text += (condition.text.empty() ? "if" : ", if") + expr; 
+        if (vm != nullptr) {
+            condition.compiled = vm_set_condition(vm, line, condition.expr); //so the VM can check it without stopping
+        }
+    } else if (word != "") {
+        cout << "unknown breakpoint option: " << word << "\n"; 
+        return false; 
+    }
+    return true; 
+}
+
+//Forget the condition of a breakpoint, if it has one
+void Debugger::removeCondition(int line) {
+    auto found = breakConditions.find(line); 
+    if (found != breakConditions.end()) {
+        if (vm != nullptr) {
+            vm_set_condition(vm, line, nullptr); 
+        }
+        destroyCondition(found->second); 
+        breakConditions.erase(found); 
+    }
+}
+
+//Free the graph a condition was parsed into
+void Debugger::destroyCondition(BreakCondition& condition) {
+    if (condition.graph != nullptr) {
+        graph_destroy(condition.graph); 
+    }
+    condition.graph = nullptr; 
+    condition.expr = nullptr; 
+}
+
+//Print "varname (type): value", or "no such variable" if cell is NULL
+void Debugger::printValue(const char* varname, const RAM_VALUE* cell) {
+    if (cell==NULL) {
+        cout << "no such variable\n"; 
+    } else {
+        int value_type = cell->value_type; 
+        cout << varname << " ("; 
+        if (value_type==RAM_TYPE_REAL) {
+            cout << "real): " << cell->types.d << " \n"; 
+        } else if (value_type==RAM_TYPE_STR) {
+            cout << "str): " << cell->types.s << " \n"; 
+        } else if (value_type == RAM_TYPE_INT) {
+            cout << "int): " << cell->types.i << " \n"; 
+        } else if (value_type == RAM_TYPE_PTR) {
+            cout << "ptr): " << cell->types.i << " \n"; 
+        } else if (value_type == RAM_TYPE_BOOLEAN) {
+            cout << "bool): " << cell->types.i << " \n"; 
+        } else {
+            cout << "none): " << "null" << " \n"; 
+        }
+    }
+}
+
+vector<Watch>::iterator Debugger::findWatch(const string& varname) {
+    return find_if(watches.begin(), watches.end(), [&](const Watch& watch) { return watch.name == varname; }); 
+}
+
+//(Un)flag the stmts that write a variable
+void Debugger::updateWatchFlags(const string& varname, bool watched) {
+    if (vm != nullptr) {
+        vm_watch(vm, (char*) varname.c_str(), watched); //VM: stores to the variable stop the VM themselves, no line flags needed
+        return; 
+    }
+
+    //execute(): flag every assignment to the variable, so the executors stop right before it
+    for (int line = 0; line < (int) lineIndex.size(); line++) {
+        STMT* stmt = lineIndex[line]; 
+        if (stmt != nullptr && stmt->stmt_type == STMT_ASSIGNMENT && varname == stmt->types.assignment->var_name) {
+            if (watched) {
+                lineFlags[line] |= WATCH_FLAG; 
+            } else {
+                lineFlags[line] &= ~WATCH_FLAG; 
+            }
+        }
+    }
+}
+
+//Remember the current value of a watched variable
+void Debugger::saveWatchValue(Watch& watch) {
+    const RAM_VALUE* cell = ram_peek_by_addr(memory, findAddr(watch.name)); 
+    watch.defined = (cell != NULL); 
+    if (cell != NULL) {
+        watch.value = *cell; 
+        if (cell->value_type == RAM_TYPE_STR) {
+            watch.str = cell->types.s; //own a copy, the cell's string is freed when the variable is written
+        }
+    }
+}
+
+//Compare the watched variables against their saved values after executed ran
+void Debugger::checkWatches(STMT* executed) {
+    for (Watch& watch : watches) {
+        const RAM_VALUE* cell = ram_peek_by_addr(memory, findAddr(watch.name)); 
+        if (cell == NULL) {
+            continue; //still doesn't exist -> unchanged
+        }
+
+        bool changed = !watch.defined || cell->value_type != watch.value.value_type; 
+        if (!changed) {
+            if (cell->value_type == RAM_TYPE_REAL) {
+                changed = (cell->types.d != watch.value.types.d); 
+            } else if (cell->value_type == RAM_TYPE_STR) {
+                changed = (watch.str != cell->types.s); 
+            } else if (cell->value_type != RAM_TYPE_NONE) {
+                changed = (cell->types.i != watch.value.types.i); 
+            }
+        }
+        if (!changed) {
+            continue; 
+        }
+
+        //Report old and new value, then remember the new one
+        cout << "watch " << watch.name << " changed at line " << executed->line << "\n"; 
+        cout << "old: "; 
+        if (watch.defined) {
+            RAM_VALUE old = watch.value; 
+            if (old.value_type == RAM_TYPE_STR) {
+                old.types.s = (char*) watch.str.c_str(); 
+            }
+            printValue(watch.name.c_str(), &old); 
+        } else {
+            printValue(watch.name.c_str(), NULL); 
+        }
+        cout << "new: "; 
+        printValue(watch.name.c_str(), cell); 
+        saveWatchValue(watch); 
+        watchTriggered = true; 
+    }
+}
+
+//Undo one stmt (output it printed can't be taken back)
+bool Debugger::stepBack() {
+    JOURNAL_RECORD record; 
+    if (journal == nullptr || !journal_pop(journal, &record)) {
+        return false; 
+    }
+
+    //Undo the write the stmt made (if any): put back the old value, or remove the variable it created
+    if (record.kind == JOURNAL_OLD_VALUE) {
+        ram_write_cell_by_addr(memory, record.old_value, record.addr); 
+    } else if (record.kind == JOURNAL_NEW_CELL) {
+        if (record.addr < indexedCells) {
+            addrIndex.erase(memory->cells[record.addr].identifier); 
+            indexedCells = record.addr; 
+        }
+        if (vm != nullptr) {
+            vm_cell_removed(vm, record.addr); //the VM caches addresses too
+        }
+        if (vmOptimized != nullptr) {
+            vm_cell_removed(vmOptimized, record.addr); 
+        }
+        ram_pop_cell(memory); 
+    }
+
+    //The undone stmt is the next one to execute again (if it's a breakpoint, we're stopped at it and s runs it)
+    currentStmt = lineIndex[record.line]; 
+    state = "Running"; 
+    second_time_breakpoint = isBreakLine(record.line); 
+    for (Watch& watch : watches) {
+        saveWatchValue(watch); //going back doesn't count as a change
+    }
+    return true; 
+}
+
+//Both engines record into the journal while it's on
+void Debugger::setJournalLimit(size_t maxBytes) {
+    if (maxBytes == 0) {
+        if (journal != nullptr) {
+            journal_destroy(journal); 
+        }
+        journal = nullptr; 
+    } else if (journal == nullptr) {
+        journal = journal_create(maxBytes); 
+    } else {
+        journal_set_limit(journal, maxBytes); //drops the oldest history if it's now over the cap
+    }
+
+    if (vm != nullptr) {
+        vm_set_journal(vm, journal); 
+    }
+}
+
+//One pass over the cells addrIndex hasn't seen yet
+void Debugger::indexNewCells() {
+    while (indexedCells < memory->num_values) {
+        addrIndex[memory->cells[indexedCells].identifier] = indexedCells; 
+        indexedCells++; 
+    }
+}
+
+//One FNV-1a step
+static unsigned int hashInt(unsigned int hash, int value) {
+    return (hash ^ (unsigned int) value) * 16777619u; 
+}
+
+static unsigned int hashString(unsigned int hash, const char* s) {
+    for (; *s != '\0'; s++) {
+        hash = hashInt(hash, (unsigned char) *s); 
+    }
+    return hashInt(hash, 0); //the terminator too, so "ab","c" and "a","bc" differ
+}
+
+static unsigned int hashElement(unsigned int hash, ELEMENT* element) {
+    hash = hashInt(hash, element->element_type); 
+    return hashString(hash, element->element_value); 
+}
+
+static unsigned int hashExpr(unsigned int hash, EXPR* expr) {
+    hash = hashInt(hash, expr->lhs->expr_type); 
+    hash = hashElement(hash, expr->lhs->element); 
+    if (expr->isBinaryExpr) {
+        hash = hashInt(hash, expr->operator_type); 
+        hash = hashInt(hash, expr->rhs->expr_type); 
+        hash = hashElement(hash, expr->rhs->element); 
+    }
+    return hash; 
+}
+
+static unsigned int hashCall(unsigned int hash, const char* function_name, ELEMENT* parameter) {
+    hash = hashString(hash, function_name); 
+    return (parameter != nullptr) ? hashElement(hash, parameter) : hashInt(hash, -1); 
+}
+
+unsigned int Debugger::programId() {
+    //FNV-1a hash of every stmt: its line, kind and contents (names, literals, operators), so programs that differ anywhere differ
+    unsigned int hash = 2166136261u; 
+    for (int line = 0; line < (int) lineIndex.size(); line++) {
+        STMT* stmt = lineIndex[line]; 
+        if (stmt == nullptr) {
+            continue; 
+        }
+        hash = hashInt(hash, line); 
+        hash = hashInt(hash, stmt->stmt_type); 
+        if (stmt->stmt_type == STMT_ASSIGNMENT) {
+            struct STMT_ASSIGNMENT* assignment = stmt->types.assignment; 
+            hash = hashString(hash, assignment->var_name); 
+            hash = hashInt(hash, assignment->isPtrDeref); 
+            hash = hashInt(hash, assignment->rhs->value_type); 
+            if (assignment->rhs->value_type == VALUE_EXPR) {
+                hash = hashExpr(hash, assignment->rhs->types.expr); 
+            } else {
+                hash = hashCall(hash, assignment->rhs->types.function_call->function_name, assignment->rhs->types.function_call->parameter); 
+            }
+        } else if (stmt->stmt_type == STMT_FUNCTION_CALL) {
+            hash = hashCall(hash, stmt->types.function_call->function_name, stmt->types.function_call->parameter); 
+        } else if (stmt->stmt_type == STMT_WHILE_LOOP) {
+            hash = hashExpr(hash, stmt->types.while_loop->condition); 
+        }
+    }
+    return hash; 
+}
+
+void Debugger::saveSnapshot(const string& filename) {
+    //Position: the stmt that executes next (head if not started yet, -1 once completed)
+    SNAPSHOT_INFO info; 
+    info.line = (state == "Completed") ? -1 : currentStmt->line; 
+    info.flags = 0; 
+    if (state != "Loaded") {
+        info.flags |= SNAPSHOT_STARTED; 
+    }
+    if (second_time_breakpoint) {
+        info.flags |= SNAPSHOT_AT_BREAKPOINT; 
+    }
+
+    if (snapshot_save(filename.c_str(), programId(), memory, &info) != SNAPSHOT_OK) {
+        cout << "unable to save " << filename << "\n"; 
+        return; 
+    }
+    cout << "saved to " << filename << "\n"; 
+}
+
+void Debugger::loadSnapshot(const string& filename) {
+    SNAPSHOT_INFO info; 
+    int status = snapshot_load(filename.c_str(), programId(), memory, &info); 
+    if (status == SNAPSHOT_IO_ERROR) {
+        cout << "unable to open " << filename << "\n"; 
+        return; 
+    } else if (status == SNAPSHOT_WRONG_PROGRAM) {
+        cout << filename << " is a snapshot of a different program\n"; 
+        return; 
+    } else if (status != SNAPSHOT_OK) {
+        cout << filename << " is not a valid snapshot\n"; 
+        return; 
+    }
+
+    //Memory was replaced as a whole: rebuild the name index in one pass, forget cached addresses and the history of the old memory
+    addrIndex.clear(); 
+    addrIndex.reserve(memory->num_values); 
+    indexedCells = 0; 
+    indexNewCells(); 
+    if (vm != nullptr) {
+        vm_memory_reset(vm); 
+    }
+    if (vmOptimized != nullptr) {
+        vm_memory_reset(vmOptimized); 
+    }
+    if (journal != nullptr) {
+        journal_clear(journal); 
+    }
+
+    //Position (the program id matched, so the line has a stmt)
+    if (info.line < 0 || info.line >= (int) lineIndex.size() || lineIndex[info.line] == nullptr) {
+        state = "Completed"; 
+        currentStmt = nullptr; 
+    } else {
+        state = (info.flags & SNAPSHOT_STARTED) ? "Running" : "Loaded"; 
+        currentStmt = lineIndex[info.line]; 
+    }
+    second_time_breakpoint = (info.flags & SNAPSHOT_AT_BREAKPOINT) != 0; 
+    for (Watch& watch : watches) {
+        saveWatchValue(watch); 
+    }
+
+    cout << "loaded " << filename << "\n"; 
+    if (currentStmt != nullptr) {
+        cout << "line " << currentStmt->line << "\n"; 
+        printStmt(currentStmt); 
+    }
+}
+
+//Switch the program output sink
+bool Debugger::setOutput(int kind, const string& filename) {
+    OUTPUT_SINK* sink = sink_create(kind, filename.c_str()); 
+    if (sink == nullptr) {
+        return false; //keep the current sink
+    }
+    if (output != nullptr) {
+        sink_destroy(output); //flushes it, so nothing output so far is lost
+    }
+    output = sink; 
+    return true; 
+}
+
+
 
@@ -8,29 +8,72 @@
 #pragma once
 
 #include <string> 
-#include <set> 
+#include <vector>
+#include <unordered_map>
 #include <algorithm>
 
 #include "execute.h"
 #include "programgraph.h"
 #include "ram.h"
+#include "stepper.h"
+#include "vm.h"
+#include "journal.h"
+#include "optimize.h"
+#include "snapshot.h"
+#include "sink.h"
+#include "syntax.h"
+#include "graph.h"
 
 using namespace std;
 
+//Extra state of a conditional breakpoint and/or one with an ignore count ("b n after k if expr")
+struct BreakCondition {
+  string text; //What the user typed after the line number, for lb
+  EXPR* expr = nullptr; //Parsed condition, nullptr if none (points into graph below)
+  PROGRAM_GRAPH* graph = nullptr; //Program graph the condition was parsed into ("x = expr"), owned
+  long ignore = 0; //How many more times reaching the line (with the condition true) is ignored
+  bool compiled = false; //true if the VM evaluates the condition itself while running
+};
+
+//Flags kept per line in lineFlags, the executors stop before any line that has a flag set
+enum LineFlags {
+  BREAK_FLAG = 1, //breakpoint on this line
+  WATCH_FLAG = 2  //stmt on this line assigns a watched variable (execute() engine only, the VM tracks its own stores)
+};
+
+//A watched variable and the value it had when last checked
+struct Watch {
+  string name; 
+  bool defined = false; //false if the variable didn't exist yet
+  RAM_VALUE value; //Last value (for a str, the string is kept in str below)
+  string str; 
+};
+
 class Debugger {
 private: 
   string state; //Holds state string ("Loaded", "Running", "Completed")
   STMT* head; //Points to first programgraph node (same inititially as currentStmt, but head will remain unchanged)
-  STMT* currentStmt; //Holds where we're at currently in the programgraph, this is the context (starting position) that execute() needs
-  STMT* next; //Next node in relation to currentStmt
+  STMT* currentStmt; //Holds where we're at currently in the programgraph (the next stmt to execute, may be inside a loop body), nullptr once completed
   RAM* memory; //RAM memory 
-  set<int> breakpoints; //Set of breakpoint line numbers 
+  VM_PROGRAM* vm; //Compiled bytecode when debugging on the VM engine, nullptr when stepping the programgraph with execute()
+  OPTIMIZED_PROGRAM* optimized; //Optimized programgraph that r runs when nothing can stop it (see optimize.h), nullptr if not optimizing
+  VM_PROGRAM* vmOptimized; //The optimized programgraph compiled for the VM engine, nullptr when not on the VM
+  bool batch; //true if the commands come from a script: no prompts
+  vector<unsigned char> lineFlags; //Flags indexed by line number (see LineFlags), what step() and the executors check
   bool second_time_breakpoint; //flag that determines if the current breakpoint line is being seen for the first or second time
-  set<int> lines; //Set of program graph line numbers, makes it easy to see if a breakpoint line exists in the graph
+  vector<Watch> watches; //Watched variables (a handful at most, so a vector)
+  bool watchTriggered; //true if the last executeOneLine/runToBreakpoint changed a watched variable
+  unordered_map<int, BreakCondition> breakConditions; //Line -> condition/ignore count, only for breakpoints that have one (only looked at when such a line is reached)
+  vector<STMT*> lineIndex; //Line number -> stmt on that line (nullptr if none), covers loop bodies too
+  unordered_map<string, int> addrIndex; //Variable name -> RAM address, valid until a bs/rr removes the variable (RAM addresses never change once written)
+  int indexedCells; //Number of RAM cells (starting at address 0) that have been added to addrIndex so far
+  JOURNAL* journal; //Undo journal of every stmt executed and the RAM write it made (for bs/rr), nullptr if turned off
+  OUTPUT_SINK* output; //Where the program's own output goes (console, memory or file), flushed whenever execution stops
   
 public:
-  //Constructor 
-  Debugger(struct STMT* program);
+  //Constructor (pass a compiled program to debug on the bytecode VM instead of execute(), batch to leave out the prompts,
+  //an optimized program (and its bytecode on the VM) to run it whenever nothing can stop the run -- the journal then starts off)
+  Debugger(struct STMT* program, struct VM_PROGRAM* vm = nullptr, bool batch = false, struct OPTIMIZED_PROGRAM* optimized = nullptr, struct VM_PROGRAM* vmOptimized = nullptr);
 
   //Destructor
   ~Debugger();
@@ -44,14 +87,82 @@ public:
   //Helper function to moduralize the "execute one line" operation 
   void executeOneLine(); 
 
-  //Helper function to break the graph at an input node (node's next set to null)
-  void breakGraph(STMT* node); 
+  //Helper function to run from currentStmt until the next breakpoint line (or the end) without stepping stmt by stmt
+  void runToBreakpoint(); 
+
+  //Helper function to check whether runToBreakpoint can run the optimized programgraph (nothing can stop the run)
+  bool canRunOptimized(); 
+
+  //Helper function to run the optimized programgraph from currentStmt to the end (or an error)
+  void runOptimized(); 
+
+  //Helper function to fill lineIndex from the whole programgraph
+  void buildLineIndex(); 
+
+  //Helper function to print a single statement (not the rest of the program after it)
+  void printStmt(STMT* node); 
+
+  //Helper function to check the breakpoint bitmap for a line
+  bool isBreakLine(int line); 
+
+  //Helper function to check the line flags for an assignment to a watched variable
+  bool isWatchLine(int line); 
+
+  //Helper function to decide if reaching a line stops execution (breakpoint whose condition holds, ignore count used up)
+  //(conditionChecked: the VM already found the condition true, only the ignore count is left to check)
+  bool shouldBreak(int line, bool conditionChecked = false); 
+
+  //Helper function to print the "hit breakpoint" message for currentStmt and arm the second time flag
+  void announceBreakpoint(); 
+
+  //Helper function to parse the "after k" / "if expr" options of the b command into a condition
+  bool parseCondition(int line, const string& options, BreakCondition& condition); 
+
+  //Helper function to remove the condition (if any) of the breakpoint at a line
+  void removeCondition(int line); 
+
+  //Helper function to free what a condition was parsed into
+  void destroyCondition(BreakCondition& condition); 
+
+  //Helper function to print a variable the way the p command does
+  void printValue(const char* varname, const RAM_VALUE* cell); 
+
+  //Helper function to find a watch by variable name (watches.end() if not watched)
+  vector<Watch>::iterator findWatch(const string& varname); 
+
+  //Helper function to make the engine stop at writes to a variable (or not anymore)
+  void updateWatchFlags(const string& varname, bool watched); 
+
+  //Helper function to remember the current value of a watched variable
+  void saveWatchValue(Watch& watch); 
+
+  //Helper function to report watched variables that changed (sets watchTriggered), executed is the stmt that just ran
+  void checkWatches(STMT* executed); 
+
+  //Helper function to look up the RAM address of a variable by name (-1 if no such variable)
+  int findAddr(const string& varname); 
+
+  //Helper function to check the condition of a breakpoint (true if it has none), without using up its ignore count
+  bool conditionHolds(int line); 
+
+  //Helper function to undo the last stmt executed using the journal (false if there's nothing left to undo)
+  bool stepBack(); 
+
+  //Helper function to turn the journal on with a cap of maxBytes, or off if maxBytes is 0
+  void setJournalLimit(size_t maxBytes); 
+
+  //Helper function to add the RAM cells written since the last call to addrIndex
+  void indexNewCells(); 
+
+  //Helper function to identify the program (a hash of all of its stmts), so a snapshot of one program isn't loaded into another
+  unsigned int programId(); 
 
-  //Helper function to repair the graph at the node->next connection 
-  void repairGraph(STMT* node, STMT* next); 
+  //Helper functions for the save/load commands (print what happened)
+  void saveSnapshot(const string& filename); 
+  void loadSnapshot(const string& filename); 
 
-  //Helper function to get the next node relative to input node 
-  STMT* getNextNode(STMT* node); 
+  //Helper function to send the program's output somewhere else (flushes what's buffered for the old sink first)
+  bool setOutput(int kind, const string& filename); 
 
 };
 
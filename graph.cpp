@@ -0,0 +1,54 @@
+/*graph.cpp*/
+
+//
+// Program graphs allocated from an arena. See graph.h; the graphs
+// are built by syntax.cpp.
+//
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "graph.h"
+
+using namespace std;
+
+
+//
+// graph_create
+//
+struct PROGRAM_GRAPH* graph_create(void)
+{
+  PROGRAM_GRAPH* graph = new PROGRAM_GRAPH;
+
+  graph->program = NULL;
+  graph->arena = arena_create();
+  graph->unsupported = NULL;
+
+  return graph;
+}
+
+
+//
+// graph_destroy
+//
+void graph_destroy(struct PROGRAM_GRAPH* graph)
+{
+  arena_destroy(graph->arena);
+  delete graph;
+}
+
+
+//
+// graph_check
+//
+void graph_check(struct PROGRAM_GRAPH* graph)
+{
+  if (graph->unsupported == NULL)
+    return;
+
+  printf("**PROGRAMGRAPH ERROR\n");
+  printf("**PROGRAMGRAPH ERROR: %s\n", graph->unsupported);
+  printf("**PROGRAMGRAPH ERROR\n");
+
+  exit(-123);
+}
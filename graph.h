@@ -0,0 +1,59 @@
+/*graph.h*/
+
+//
+// Program graphs allocated from an arena: the same graph of STMT,
+// VALUE, EXPR, UNARY_EXPR and ELEMENT nodes programgraph_build()
+// returns, but every node and string of it is carved out of one
+// arena owned by a graph handle, instead of being malloc'd on its
+// own. Building a big program's graph is then a run of pointer bumps,
+// and destroying it frees a few large blocks rather than walking the
+// graph and freeing every node.
+//
+// syntax_parse() builds these graphs as it checks a program's syntax.
+// Nothing in such a graph may be freed on its own -- in particular,
+// never pass its program to programgraph_destroy().
+//
+
+#pragma once
+
+#include "programgraph.h"
+#include "arena.h"
+
+
+struct PROGRAM_GRAPH
+{
+  struct STMT*  program;      // the graph, NULL if the program is empty
+  struct ARENA* arena;        // every node and string of the graph
+
+  const char*   unsupported;  // why the graph is incomplete, NULL if it isn't
+};
+
+
+//
+// Public functions:
+//
+
+//
+// graph_create
+//
+// Returns a new, empty graph to build into. Call graph_destroy() to
+// free it.
+//
+struct PROGRAM_GRAPH* graph_create(void);
+
+//
+// graph_destroy
+//
+// Frees the graph, all at once.
+//
+void graph_destroy(struct PROGRAM_GRAPH* graph);
+
+//
+// graph_check
+//
+// If the program uses something the program graph can't represent
+// yet (such as an if statement), so the graph is incomplete, outputs
+// the error programgraph_build() would and exits. Otherwise does
+// nothing.
+//
+void graph_check(struct PROGRAM_GRAPH* graph);
@@ -0,0 +1,510 @@
+/*infer.cpp*/
+
+//
+// Static type inference for nuPython. See infer.h.
+//
+// The pass is an abstract interpretation of the program: it walks
+// the statements the way execution does, but with the set of types
+// each variable can have (a bit per RAM_VALUE_TYPES, plus one for
+// "not assigned yet") in place of its value. At the top of a while
+// loop the sets can only grow from one pass over the body to the
+// next, so iterating until they stop growing takes at most a few
+// passes per variable. What a visit of a statement finds replaces
+// what the visit before found, so the facts left at the end are the
+// ones derived from the final, stable sets.
+//
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "infer.h"
+#include "ram.h"
+
+using namespace std;
+
+
+#define TYPE_BIT(type)  (1u << (type))
+#define TYPE_UNDEFINED  (1u << 8)  // not assigned yet
+#define TYPE_ANY        (TYPE_BIT(RAM_TYPE_INT) | TYPE_BIT(RAM_TYPE_REAL) | TYPE_BIT(RAM_TYPE_STR) | \
+                         TYPE_BIT(RAM_TYPE_PTR) | TYPE_BIT(RAM_TYPE_BOOLEAN) | TYPE_BIT(RAM_TYPE_NONE))
+#define TYPE_INVALID    0u         // no value: evaluating fails
+
+typedef unsigned TYPES;      // a set of possible types
+typedef vector<TYPES> STATE; // variable index -> its possible types
+
+struct OPERANDS
+{
+  int lhs_type;  // enum RAM_VALUE_TYPES
+  int rhs_type;
+};
+
+struct INFERENCE
+{
+  unordered_map<string_view, int> vars; // variable name (in the graph) -> index into a STATE
+  unordered_map<EXPR*, OPERANDS> proven; // binary expression -> its proven operand types
+  map<STMT*, string> errors;            // statement -> the error executing it is certain to output
+  bool reachable = true;                // can the statement being analyzed run?
+};
+
+
+//
+// helpers:
+//
+
+static int infer_var(INFERENCE* inference, const char* name)
+{
+  auto found = inference->vars.find(name);
+  if (found != inference->vars.end())
+    return found->second;
+
+  int var = (int) inference->vars.size();
+  inference->vars[name] = var;
+  return var;
+}
+
+static TYPES var_types(const STATE& state, int var)
+{
+  return (var < (int) state.size()) ? state[var] : TYPE_UNDEFINED;
+}
+
+static void set_var(STATE& state, int var, TYPES types)
+{
+  if (var >= (int) state.size())
+    state.resize(var + 1, TYPE_UNDEFINED);
+
+  state[var] = types;
+}
+
+//
+// into = the union of into and from, variable by variable; returns
+// true if into changed:
+//
+static bool infer_join(STATE& into, const STATE& from)
+{
+  bool changed = false;
+
+  if (into.size() < from.size())
+    into.resize(from.size(), TYPE_UNDEFINED);
+
+  for (size_t var = 0; var < into.size(); var++) {
+    TYPES types = into[var] | ((var < from.size()) ? from[var] : TYPE_UNDEFINED);
+
+    if (types != into[var]) {
+      into[var] = types;
+      changed = true;
+    }
+  }
+
+  return changed;
+}
+
+//
+// the single type in types, -1 if there are none or several:
+//
+static int single_type(TYPES types)
+{
+  if (types == 0 || (types & (types - 1)) != 0)
+    return -1;
+
+  return __builtin_ctz(types);
+}
+
+//
+// notes that executing stmt is certain to fail with the given
+// message (category included), unless an earlier part of it is
+// already certain to, or the statement can never run:
+//
+static void infer_error(INFERENCE* inference, STMT* stmt, const string& message)
+{
+  if (inference->reachable)
+    inference->errors.emplace(stmt, message);
+}
+
+//
+// The type of lhs_type <oper> rhs_type, as execute_binary_expression
+// computes it: TYPE_INVALID if it outputs "invalid operand types",
+// TYPE_ANY for the operators it doesn't evaluate on numbers (is, in),
+// and for "in" on two strings, which execute() rejects but the VM
+// evaluates (see vm.h).
+//
+static TYPES binary_result(int lhs_type, int oper, int rhs_type)
+{
+  bool numbers = (lhs_type == RAM_TYPE_INT || lhs_type == RAM_TYPE_REAL) &&
+                 (rhs_type == RAM_TYPE_INT || rhs_type == RAM_TYPE_REAL);
+  bool comparison = (oper >= OPERATOR_EQUAL && oper <= OPERATOR_GTE);
+
+  if (numbers) {
+    if (oper == OPERATOR_IS || oper == OPERATOR_IN || oper == OPERATOR_NO_OP)
+      return TYPE_ANY;
+    if (comparison)
+      return TYPE_BIT(RAM_TYPE_BOOLEAN);
+    if (lhs_type == RAM_TYPE_INT && rhs_type == RAM_TYPE_INT)
+      return TYPE_BIT(RAM_TYPE_INT);
+    return TYPE_BIT(RAM_TYPE_REAL);
+  }
+
+  if (lhs_type == RAM_TYPE_STR && rhs_type == RAM_TYPE_STR) {
+    if (oper == OPERATOR_IN)
+      return TYPE_ANY;
+    if (oper == OPERATOR_PLUS)
+      return TYPE_BIT(RAM_TYPE_STR);
+    if (comparison)
+      return TYPE_BIT(RAM_TYPE_BOOLEAN);
+  }
+
+  return TYPE_INVALID;
+}
+
+//
+// The types the element can have, TYPE_UNDEFINED included for a
+// variable that may not be assigned yet. A None literal has no type:
+// execute() can't evaluate it.
+//
+static TYPES element_types(INFERENCE* inference, const STATE& state, ELEMENT* element)
+{
+  switch (element->element_type)
+  {
+  case ELEMENT_IDENTIFIER:
+    return var_types(state, infer_var(inference, element->element_value));
+  case ELEMENT_INT_LITERAL:
+    return TYPE_BIT(RAM_TYPE_INT);
+  case ELEMENT_REAL_LITERAL:
+    return TYPE_BIT(RAM_TYPE_REAL);
+  case ELEMENT_STR_LITERAL:
+    return TYPE_BIT(RAM_TYPE_STR);
+  case ELEMENT_TRUE:
+  case ELEMENT_FALSE:
+    return TYPE_BIT(RAM_TYPE_BOOLEAN);
+  default:
+    return TYPE_INVALID;
+  }
+}
+
+//
+// The types of the element's value, TYPE_INVALID if reading it is
+// certain to fail; reports a variable nothing can have been assigned
+// to yet if certain (nothing evaluated before it in the statement
+// may fail).
+//
+static TYPES infer_element(INFERENCE* inference, STMT* stmt, const STATE& state, ELEMENT* element, bool certain)
+{
+  TYPES types = element_types(inference, state, element);
+
+  if (types == TYPE_UNDEFINED) {
+    if (certain)
+      infer_error(inference, stmt, string("**SEMANTIC ERROR: name '") + element->element_value + "' is not defined");
+    return TYPE_INVALID;
+  }
+
+  return types & ~TYPE_UNDEFINED;
+}
+
+//
+// The types the expression's value can have, TYPE_INVALID if
+// evaluating it is certain to fail. Notes whether its operand types
+// are proven.
+//
+static TYPES infer_expr(INFERENCE* inference, STMT* stmt, const STATE& state, EXPR* expr)
+{
+  if (expr->lhs->expr_type != UNARY_ELEMENT || (expr->isBinaryExpr && expr->rhs->expr_type != UNARY_ELEMENT))
+    return TYPE_ANY;
+
+  inference->proven.erase(expr);
+
+  ELEMENT* lhs = expr->lhs->element;
+  bool certain = (element_types(inference, state, lhs) & TYPE_UNDEFINED) == 0;
+
+  TYPES lhs_types = infer_element(inference, stmt, state, lhs, true);
+
+  if (!expr->isBinaryExpr || lhs_types == TYPE_INVALID)
+    return lhs_types;
+
+  ELEMENT* rhs = expr->rhs->element;
+  TYPES rhs_types = infer_element(inference, stmt, state, rhs, certain);
+
+  if (rhs_types == TYPE_INVALID)
+    return TYPE_INVALID;
+
+  certain = certain && (element_types(inference, state, rhs) & TYPE_UNDEFINED) == 0;
+
+  //
+  // the operation's types are those of every combination of operand
+  // types it is valid on:
+  //
+  TYPES result = TYPE_INVALID;
+
+  for (int lhs_type = 0; lhs_type <= RAM_TYPE_NONE; lhs_type++)
+    for (int rhs_type = 0; rhs_type <= RAM_TYPE_NONE; rhs_type++)
+      if ((lhs_types & TYPE_BIT(lhs_type)) && (rhs_types & TYPE_BIT(rhs_type)))
+        result |= binary_result(lhs_type, expr->operator_type, rhs_type);
+
+  if (result == TYPE_INVALID && certain)
+    infer_error(inference, stmt, "**SEMANTIC ERROR: invalid operand types");
+
+  int lhs_type = single_type(lhs_types);
+  int rhs_type = single_type(rhs_types);
+
+  if (lhs_type >= 0 && rhs_type >= 0 && result != TYPE_INVALID && result != TYPE_ANY)
+    inference->proven[expr] = { lhs_type, rhs_type };
+
+  return result;
+}
+
+//
+// The types the value of an assignment's right-hand side can have,
+// TYPE_INVALID if computing it is certain to fail:
+//
+static TYPES infer_value(INFERENCE* inference, STMT* stmt, const STATE& state, VALUE* value)
+{
+  if (value->value_type == VALUE_EXPR)
+    return infer_expr(inference, stmt, state, value->types.expr);
+
+  FUNCTION_CALL* call = value->types.function_call;
+
+  if (strcmp(call->function_name, "input") == 0)
+    return TYPE_BIT(RAM_TYPE_STR);
+
+  bool is_int = (strcmp(call->function_name, "int") == 0);
+
+  if (!is_int && strcmp(call->function_name, "float") != 0)
+    return TYPE_INVALID;  // unsupported function
+
+  if (call->parameter == NULL || call->parameter->element_type != ELEMENT_IDENTIFIER)
+    return TYPE_ANY;
+
+  bool certain = (element_types(inference, state, call->parameter) & TYPE_UNDEFINED) == 0;
+  TYPES types = infer_element(inference, stmt, state, call->parameter, true);
+
+  if (types == TYPE_INVALID)
+    return TYPE_INVALID;
+
+  if ((types & TYPE_BIT(RAM_TYPE_STR)) == 0) {
+    if (certain)
+      infer_error(inference, stmt, "**SEMANTIC ERROR: invalid operand types");
+    return TYPE_INVALID;
+  }
+
+  return TYPE_BIT(is_int ? RAM_TYPE_INT : RAM_TYPE_REAL);
+}
+
+static STMT* infer_join_point(struct STMT_IF_THEN_ELSE* if_then_else);
+
+//
+// the statement execution reaches once the given one is done, a
+// while loop or if statement counting as one statement:
+//
+static STMT* infer_after(STMT* stmt)
+{
+  switch (stmt->stmt_type)
+  {
+  case STMT_ASSIGNMENT:    return stmt->types.assignment->next_stmt;
+  case STMT_FUNCTION_CALL: return stmt->types.function_call->next_stmt;
+  case STMT_WHILE_LOOP:    return stmt->types.while_loop->next_stmt;
+  case STMT_PASS:          return stmt->types.pass->next_stmt;
+  default:                 return infer_join_point(stmt->types.if_then_else);
+  }
+}
+
+//
+// the statement both paths of an if statement lead to, the first on
+// the true path that is also on the false path (NULL if they only
+// meet at the end of the program):
+//
+static STMT* infer_join_point(struct STMT_IF_THEN_ELSE* if_then_else)
+{
+  unordered_set<STMT*> on_false_path;
+
+  for (STMT* stmt = if_then_else->false_path; stmt != NULL; stmt = infer_after(stmt))
+    on_false_path.insert(stmt);
+
+  for (STMT* stmt = if_then_else->true_path; stmt != NULL; stmt = infer_after(stmt))
+    if (on_false_path.count(stmt) > 0)
+      return stmt;
+
+  return NULL;
+}
+
+//
+// the value of a loop condition that is just a True or False
+// literal: 1 or 0, -1 if it isn't one:
+//
+static int constant_condition(EXPR* condition)
+{
+  if (condition->isBinaryExpr || condition->lhs->expr_type != UNARY_ELEMENT)
+    return -1;
+
+  switch (condition->lhs->element->element_type)
+  {
+  case ELEMENT_TRUE:  return 1;
+  case ELEMENT_FALSE: return 0;
+  default:            return -1;
+  }
+}
+
+//
+// Analyzes the statements from stmt up to (not including) stop,
+// which is NULL at the top level, the while loop itself for a loop
+// body and the join point for a path of an if statement. state holds
+// the types before the first statement on entry, after the last one
+// on return. inference->reachable says whether the first statement
+// can run on entry, and whether stop can be reached on return: a
+// statement certain to fail ends the run, so nothing after it runs.
+//
+static void infer_body(INFERENCE* inference, STMT* stmt, STMT* stop, STATE& state)
+{
+  while (stmt != stop && stmt != NULL)
+  {
+    if (!inference->errors.empty())
+      inference->errors.erase(stmt);
+
+    STMT* current = stmt;
+
+    if (stmt->stmt_type == STMT_ASSIGNMENT) {
+      struct STMT_ASSIGNMENT* assign = stmt->types.assignment;
+
+      TYPES types = infer_value(inference, stmt, state, assign->rhs);
+
+      //
+      // if the statement is certain to fail, nothing after it runs;
+      // don't let that make later uses of the variable look wrong:
+      //
+      if (types == TYPE_INVALID)
+        types = TYPE_ANY;
+
+      if (assign->isPtrDeref) {
+        //
+        // could be a write to any variable:
+        //
+        for (TYPES& var : state)
+          var |= types;
+      }
+      else {
+        set_var(state, infer_var(inference, assign->var_name), types);
+      }
+
+      stmt = assign->next_stmt;
+    }
+    else if (stmt->stmt_type == STMT_FUNCTION_CALL) {
+      struct STMT_FUNCTION_CALL* call = stmt->types.function_call;
+
+      if (call->parameter != NULL && strcmp(call->function_name, "print") == 0)
+        infer_element(inference, stmt, state, call->parameter, true);
+
+      stmt = call->next_stmt;
+    }
+    else if (stmt->stmt_type == STMT_WHILE_LOOP) {
+      struct STMT_WHILE_LOOP* loop = stmt->types.while_loop;
+
+      //
+      // the types at the top of the loop are those on entry or after
+      // any number of passes through the body; the loop is left from
+      // the top, when the condition is false. The body only runs if
+      // the condition can be true, and the loop is only left if it
+      // can be false:
+      //
+      bool reachable = inference->reachable;
+      int  constant = constant_condition(loop->condition);
+
+      for (;;) {
+        inference->errors.erase(stmt);
+        inference->reachable = reachable;
+        infer_expr(inference, stmt, state, loop->condition);
+
+        bool fails = (inference->errors.count(stmt) > 0);
+
+        STATE body = state;
+        inference->reachable = reachable && !fails && constant != 0;
+        infer_body(inference, loop->loop_body, stmt, body);
+
+        if (!infer_join(state, body))
+          break;
+      }
+
+      inference->reachable = reachable && inference->errors.count(stmt) == 0 && constant != 1;
+      stmt = loop->next_stmt;
+      continue;
+    }
+    else if (stmt->stmt_type == STMT_IF_THEN_ELSE) {
+      struct STMT_IF_THEN_ELSE* if_then_else = stmt->types.if_then_else;
+
+      //
+      // (the condition's type isn't declared in programgraph.h, so
+      // it isn't analyzed; whichever path is taken, the types after
+      // the if are those after one of them)
+      //
+      STMT* join = infer_join_point(if_then_else);
+
+      bool reachable = inference->reachable;
+
+      STATE false_path = state;
+      infer_body(inference, if_then_else->true_path, join, state);
+
+      bool true_path_reachable = inference->reachable;
+
+      inference->reachable = reachable;
+      infer_body(inference, if_then_else->false_path, join, false_path);
+      infer_join(state, false_path);
+
+      inference->reachable = inference->reachable || true_path_reachable;
+      stmt = join;
+      continue;
+    }
+    else {
+      stmt = stmt->types.pass->next_stmt;
+    }
+
+    if (inference->errors.count(current) > 0)
+      inference->reachable = false;
+  }
+}
+
+
+//
+// public functions:
+//
+struct INFERENCE* infer_types(struct STMT* program)
+{
+  INFERENCE* inference = new INFERENCE;
+  STATE state;
+
+  infer_body(inference, program, NULL, state);
+
+  return inference;
+}
+
+void infer_destroy(struct INFERENCE* inference)
+{
+  delete inference;
+}
+
+int infer_report(struct INFERENCE* inference)
+{
+  vector<pair<STMT*, string>> errors(inference->errors.begin(), inference->errors.end());
+
+  stable_sort(errors.begin(), errors.end(),
+    [](const pair<STMT*, string>& a, const pair<STMT*, string>& b) { return a.first->line < b.first->line; });
+
+  for (auto& error : errors)
+    printf("%s (line %d)\n", error.second.c_str(), error.first->line);
+
+  return (int) errors.size();
+}
+
+bool infer_operands(struct INFERENCE* inference, struct EXPR* expr, int* lhs_type, int* rhs_type)
+{
+  auto found = inference->proven.find(expr);
+  if (found == inference->proven.end())
+    return false;
+
+  *lhs_type = found->second.lhs_type;
+  *rhs_type = found->second.rhs_type;
+  return true;
+}
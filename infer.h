@@ -0,0 +1,82 @@
+/*infer.h*/
+
+//
+// Static type inference for nuPython. One pass over the program
+// graph, before the program runs, works out the types every variable
+// can have at every statement -- as a set of RAM_VALUE_TYPES, since a
+// variable may be assigned values of different types -- following
+// the program's control flow: a while loop's body is analyzed until
+// the types at the top of the loop stop changing, and the types after
+// an if statement are those of either branch.
+//
+// From that it knows, for each binary expression, the types its
+// operands can have. Where each operand can only have one type and
+// the operation is valid on them, the operand types are proven, and
+// the VM compiles the expression to an instruction that doesn't check
+// them (see vm.h). Where no combination of operand types is valid, or
+// a variable is used before anything could have been assigned to it,
+// executing the statement is certain to fail, and the pass can report
+// it before the program runs. Only statements that can run are
+// reported: not those after one certain to fail, nor the body of a
+// "while False" loop or what follows a "while True" one.
+//
+// Expressions execute() doesn't evaluate (unary operators, pointer
+// dereferences, "is" and "in" on numbers) have unknown types and are
+// never reported. Pointer assignments (*p = ...) could write to any
+// variable, so after one every variable may also have the assigned
+// type.
+//
+
+#pragma once
+
+#include "programgraph.h"
+
+
+struct INFERENCE;  // opaque, see infer.cpp
+
+
+//
+// Public functions:
+//
+
+//
+// infer_types
+//
+// Analyzes the given program graph and returns what it found. Call
+// infer_destroy() to free it.
+//
+// NOTE: the result refers to nodes of the graph, so it may only be
+// used while the graph exists.
+//
+struct INFERENCE* infer_types(struct STMT* program);
+
+//
+// infer_destroy
+//
+// Frees the results of infer_types().
+//
+void infer_destroy(struct INFERENCE* inference);
+
+//
+// infer_report
+//
+// Outputs the errors found, in line order, one per statement, with
+// the same message executing the statement would output:
+//
+//   **SEMANTIC ERROR: invalid operand types (line 12)
+//   **SEMANTIC ERROR: name 'x' is not defined (line 14)
+//
+// Returns the number of errors output.
+//
+int infer_report(struct INFERENCE* inference);
+
+//
+// infer_operands
+//
+// If the operand types of the given binary expression are proven --
+// every time the expression is evaluated, its lhs has one type and
+// its rhs another (enum RAM_VALUE_TYPES), and the operator is valid
+// on them -- sets *lhs_type and *rhs_type and returns true. Returns
+// false otherwise.
+//
+bool infer_operands(struct INFERENCE* inference, struct EXPR* expr, int* lhs_type, int* rhs_type);
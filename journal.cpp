@@ -0,0 +1,404 @@
+/*journal.cpp*/
+
+//
+// Undo journal of nuPython statement executions. See journal.h.
+//
+// A record is written front to back and read back to front, so its
+// last byte is its kind, and everything before it can be located
+// from the end:
+//
+//   no write:   [line:4] [kind:1]
+//   new cell:   [line:4] [addr:4] [kind:1]
+//   old value:  [line:4] [addr:4] [payload] [value_type:1] [kind:1]
+//
+// where the payload is 4 bytes for int/ptr/bool, 8 for real, the
+// characters followed by [length:4] for str, and nothing for None.
+// A string recorded by reference has the type JOURNAL_TYPE_ROPE and
+// the rope pointer as its payload; the journal owns a reference to
+// the rope until the record is popped or dropped. Such a record takes
+// up as much room in its chunk as the copy would have, though only
+// the pointer is stored, so the journal keeps exactly as much history
+// whichever way a string was recorded. A record never spans two
+// chunks.
+//
+// journal_begin() only notes the line: the record is written when
+// the statement's write is recorded, or as a no write record when
+// the next statement begins. So a statement is written once, in one
+// piece, and never reopened.
+//
+
+#include <deque>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+
+#include "journal.h"
+
+using namespace std;
+
+
+#define JOURNAL_CHUNK_SIZE (64 * 1024)
+#define JOURNAL_TYPE_ROPE  127  // value type of a string recorded by reference
+
+struct JOURNAL_CHUNK
+{
+  char*  data;
+  size_t size;  // bytes of room
+  size_t used;  // bytes holding records
+  int    ropes; // records in the chunk holding a rope reference
+  size_t held;  // room taken by those records beyond what they use
+};
+
+struct JOURNAL
+{
+  deque<JOURNAL_CHUNK> chunks;  // oldest first
+  size_t max_bytes;
+  size_t bytes;                 // total size of the chunks
+  JOURNAL_CHUNK* last;          // the newest chunk, NULL if there are none
+
+  bool pending;                 // the latest statement is begun but not written,
+  int  pending_line;            // and this is its line
+
+  vector<char> popped;          // string of the last popped record
+};
+
+
+//
+// helpers:
+//
+
+//
+// drops the references held by the records of a chunk, walking
+// them back to front:
+//
+static void journal_release(JOURNAL_CHUNK* chunk)
+{
+  size_t pos = chunk->used;
+
+  while (chunk->ropes > 0 && pos > 0) {
+    char kind = chunk->data[--pos];
+
+    if (kind == JOURNAL_OLD_VALUE) {
+      char type = chunk->data[--pos];
+
+      if (type == JOURNAL_TYPE_ROPE) {
+        ROPE* rope;
+        pos -= sizeof(rope);
+        memcpy(&rope, chunk->data + pos, sizeof(rope));
+        rope_unref(rope);
+        chunk->ropes--;
+      }
+      else if (type == RAM_TYPE_STR) {
+        int len;
+        pos -= sizeof(len);
+        memcpy(&len, chunk->data + pos, sizeof(len));
+        pos -= len;
+      }
+      else if (type == RAM_TYPE_REAL)
+        pos -= sizeof(double);
+      else if (type != RAM_TYPE_NONE)
+        pos -= sizeof(int);
+    }
+
+    if (kind != JOURNAL_NO_WRITE)
+      pos -= sizeof(int);  // addr
+
+    pos -= sizeof(int);  // line
+  }
+}
+
+//
+// the room a rope record takes beyond its size, so it takes as much
+// as a record of a copy of the string ([chars] [length:4]):
+//
+static size_t journal_rope_extra(ROPE* rope)
+{
+  size_t copy = rope->length + sizeof(int);
+
+  return (copy > sizeof(rope)) ? copy - sizeof(rope) : 0;
+}
+
+static void journal_drop_oldest(JOURNAL* journal)
+{
+  journal_release(&journal->chunks.front());
+  free(journal->chunks.front().data);
+  journal->bytes -= journal->chunks.front().size;
+  journal->chunks.pop_front();
+}
+
+static void journal_enforce_limit(JOURNAL* journal)
+{
+  //
+  // the newest chunk always stays, it has the record being written:
+  //
+  while (journal->chunks.size() > 1 && journal->bytes > journal->max_bytes)
+    journal_drop_oldest(journal);
+}
+
+//
+// starts a new chunk with room for n bytes plus extra bytes of room
+// that won't be used:
+//
+static JOURNAL_CHUNK* journal_new_chunk(JOURNAL* journal, size_t n, size_t extra)
+{
+  JOURNAL_CHUNK chunk;
+  chunk.size = (n + extra > JOURNAL_CHUNK_SIZE) ? n + extra : JOURNAL_CHUNK_SIZE;
+  chunk.data = (char*) malloc((n + extra > JOURNAL_CHUNK_SIZE) ? n : JOURNAL_CHUNK_SIZE);
+  chunk.used = 0;
+  chunk.ropes = 0;
+  chunk.held = 0;
+
+  journal->chunks.push_back(chunk);
+  journal->bytes += chunk.size;
+  journal_enforce_limit(journal);
+
+  journal->last = &journal->chunks.back();
+  return journal->last;
+}
+
+//
+// returns a chunk with room for n more bytes plus extra bytes of
+// room that won't be used, starting a new one if the newest chunk is
+// full:
+//
+static inline JOURNAL_CHUNK* journal_room(JOURNAL* journal, size_t n, size_t extra = 0)
+{
+  JOURNAL_CHUNK* last = journal->last;
+
+  if (last != NULL && last->size - last->used - last->held >= n + extra)
+    return last;
+
+  return journal_new_chunk(journal, n, extra);
+}
+
+//
+// a record is written through a pointer into its chunk, which
+// journal_put() advances:
+//
+static inline char* journal_put(char* at, const void* p, size_t n)
+{
+  memcpy(at, p, n);
+  return at + n;
+}
+
+static void journal_take(JOURNAL_CHUNK* chunk, void* p, size_t n)
+{
+  chunk->used -= n;
+  memcpy(p, chunk->data + chunk->used, n);
+}
+
+//
+// starts writing the pending statement as a record of n more bytes
+// (plus extra bytes of room), taking up room for all of it in the
+// newest chunk; returns where the rest goes, right after the line:
+//
+static inline char* journal_write_line(JOURNAL* journal, size_t n, size_t extra = 0)
+{
+  JOURNAL_CHUNK* chunk = journal_room(journal, sizeof(journal->pending_line) + n, extra);
+  char* at = chunk->data + chunk->used;
+
+  chunk->used += sizeof(journal->pending_line) + n;
+  journal->pending = false;
+
+  return journal_put(at, &journal->pending_line, sizeof(journal->pending_line));
+}
+
+//
+// writes the pending statement as a no write record:
+//
+static void journal_write_pending(JOURNAL* journal)
+{
+  char kind = JOURNAL_NO_WRITE;
+  char* at = journal_write_line(journal, 1);
+
+  journal_put(at, &kind, 1);
+}
+
+
+//
+// public functions:
+//
+struct JOURNAL* journal_create(size_t max_bytes)
+{
+  JOURNAL* journal = new JOURNAL;
+  journal->max_bytes = max_bytes;
+  journal->bytes = 0;
+  journal->last = NULL;
+  journal->pending = false;
+  journal->pending_line = 0;
+  return journal;
+}
+
+void journal_destroy(struct JOURNAL* journal)
+{
+  journal_clear(journal);
+  delete journal;
+}
+
+void journal_set_limit(struct JOURNAL* journal, size_t max_bytes)
+{
+  journal->max_bytes = max_bytes;
+  journal_enforce_limit(journal);
+}
+
+void journal_clear(struct JOURNAL* journal)
+{
+  journal->pending = false;
+
+  while (!journal->chunks.empty())
+    journal_drop_oldest(journal);
+
+  journal->last = NULL;
+}
+
+bool journal_empty(struct JOURNAL* journal)
+{
+  if (journal->pending)
+    return false;
+
+  for (JOURNAL_CHUNK& chunk : journal->chunks)
+    if (chunk.used > 0)
+      return false;
+
+  return true;
+}
+
+void journal_begin(struct JOURNAL* journal, int line)
+{
+  if (journal->pending)
+    journal_write_pending(journal);
+
+  journal->pending = true;
+  journal->pending_line = line;
+}
+
+void journal_old_value(struct JOURNAL* journal, int addr, const struct RAM_VALUE* old_value)
+{
+  char kind = JOURNAL_OLD_VALUE;
+  char type = (char) old_value->value_type;
+  int  len = 0;
+  size_t payload;
+
+  if (old_value->value_type == RAM_TYPE_REAL)
+    payload = sizeof(double);
+  else if (old_value->value_type == RAM_TYPE_STR) {
+    len = (int) strlen(old_value->types.s);
+    payload = len + sizeof(len);
+  }
+  else if (old_value->value_type == RAM_TYPE_NONE)
+    payload = 0;
+  else
+    payload = sizeof(int);
+
+  char* at = journal_write_line(journal, sizeof(addr) + payload + 2);
+
+  at = journal_put(at, &addr, sizeof(addr));
+
+  if (old_value->value_type == RAM_TYPE_REAL)
+    at = journal_put(at, &old_value->types.d, sizeof(double));
+  else if (old_value->value_type == RAM_TYPE_STR) {
+    at = journal_put(at, old_value->types.s, len);
+    at = journal_put(at, &len, sizeof(len));
+  }
+  else if (old_value->value_type != RAM_TYPE_NONE)
+    at = journal_put(at, &old_value->types.i, sizeof(int));
+
+  at = journal_put(at, &type, 1);
+  journal_put(at, &kind, 1);
+}
+
+void journal_old_string(struct JOURNAL* journal, int addr, struct ROPE* old)
+{
+  char kind = JOURNAL_OLD_VALUE;
+  char type = JOURNAL_TYPE_ROPE;
+
+  size_t extra = journal_rope_extra(old);
+
+  char* at = journal_write_line(journal, sizeof(addr) + sizeof(old) + 2, extra);
+  JOURNAL_CHUNK* chunk = &journal->chunks.back();
+
+  rope_ref(old);
+  chunk->ropes++;
+  chunk->held += extra;
+
+  at = journal_put(at, &addr, sizeof(addr));
+  at = journal_put(at, &old, sizeof(old));
+  at = journal_put(at, &type, 1);
+  journal_put(at, &kind, 1);
+}
+
+void journal_new_cell(struct JOURNAL* journal, int addr)
+{
+  char kind = JOURNAL_NEW_CELL;
+  char* at = journal_write_line(journal, sizeof(addr) + 1);
+
+  at = journal_put(at, &addr, sizeof(addr));
+  journal_put(at, &kind, 1);
+}
+
+bool journal_pop(struct JOURNAL* journal, struct JOURNAL_RECORD* record)
+{
+  if (journal->pending) {
+    record->kind = JOURNAL_NO_WRITE;
+    record->line = journal->pending_line;
+    record->addr = -1;
+    journal->pending = false;
+    return true;
+  }
+
+  while (!journal->chunks.empty() && journal->chunks.back().used == 0) {
+    free(journal->chunks.back().data);
+    journal->bytes -= journal->chunks.back().size;
+    journal->chunks.pop_back();
+    journal->last = journal->chunks.empty() ? NULL : &journal->chunks.back();
+  }
+
+  if (journal->chunks.empty())
+    return false;
+
+  JOURNAL_CHUNK* chunk = &journal->chunks.back();
+  char kind;
+
+  journal_take(chunk, &kind, 1);
+  record->kind = kind;
+  record->addr = -1;
+
+  if (kind == JOURNAL_OLD_VALUE) {
+    char type;
+    journal_take(chunk, &type, 1);
+    record->old_value.value_type = type;
+
+    if (type == RAM_TYPE_REAL)
+      journal_take(chunk, &record->old_value.types.d, sizeof(double));
+    else if (type == RAM_TYPE_STR) {
+      int len;
+      journal_take(chunk, &len, sizeof(len));
+
+      journal->popped.resize(len + 1);
+      journal_take(chunk, journal->popped.data(), len);
+      journal->popped[len] = '\0';
+
+      record->old_value.types.s = journal->popped.data();
+    }
+    else if (type == JOURNAL_TYPE_ROPE) {
+      ROPE* rope;
+      journal_take(chunk, &rope, sizeof(rope));
+      chunk->ropes--;
+      chunk->held -= journal_rope_extra(rope);
+
+      journal->popped.assign(rope_chars(rope), rope_chars(rope) + rope->length + 1);
+      rope_unref(rope);
+
+      record->old_value.value_type = RAM_TYPE_STR;
+      record->old_value.types.s = journal->popped.data();
+    }
+    else if (type != RAM_TYPE_NONE)
+      journal_take(chunk, &record->old_value.types.i, sizeof(int));
+  }
+
+  if (kind != JOURNAL_NO_WRITE)
+    journal_take(chunk, &record->addr, sizeof(record->addr));
+
+  journal_take(chunk, &record->line, sizeof(record->line));
+  return true;
+}
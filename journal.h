@@ -0,0 +1,128 @@
+/*journal.h*/
+
+//
+// Undo journal of nuPython statement executions, for stepping
+// backwards. Every executed statement appends a record: the line of
+// the statement and, if it wrote to memory, the address it wrote and
+// the value the cell held before (or the fact that the write created
+// the cell). Undoing records newest-first restores memory and tells
+// where execution was.
+//
+// Records are variable-length deltas: a statement that writes
+// nothing takes 5 bytes, an int assignment 14. They are packed into
+// fixed-size chunks; once the journal holds more than its cap, the
+// oldest chunk is dropped, so the journal can stay on for runs of any
+// length and simply forgets the distant past.
+//
+// The VM keeps long strings as ropes (see rope.h); the old value of
+// such a string is recorded as a reference to the rope rather than a
+// copy of its characters; it still counts towards the cap as if it
+// were a copy.
+//
+
+#pragma once
+
+#include <stddef.h>
+
+#include "ram.h"
+#include "rope.h"
+
+
+struct JOURNAL;  // opaque, see journal.cpp
+
+enum JOURNAL_RECORD_KINDS
+{
+  JOURNAL_NO_WRITE = 0,  // statement didn't write memory
+  JOURNAL_OLD_VALUE,     // statement overwrote the cell at addr, old_value is what it held
+  JOURNAL_NEW_CELL       // statement created the cell at addr (the last cell)
+};
+
+struct JOURNAL_RECORD
+{
+  int kind;  // enum JOURNAL_RECORD_KINDS
+  int line;  // line of the statement
+  int addr;  // cell written, for JOURNAL_OLD_VALUE and JOURNAL_NEW_CELL
+  struct RAM_VALUE old_value;  // for JOURNAL_OLD_VALUE
+};
+
+
+//
+// Public functions:
+//
+
+//
+// journal_create
+//
+// Returns a new, empty journal that keeps at most (roughly)
+// max_bytes of records. Call journal_destroy() to free it.
+//
+struct JOURNAL* journal_create(size_t max_bytes);
+
+//
+// journal_destroy
+//
+void journal_destroy(struct JOURNAL* journal);
+
+//
+// journal_set_limit
+//
+// Changes the cap on the memory used for records, dropping the
+// oldest records if the journal is now over it.
+//
+void journal_set_limit(struct JOURNAL* journal, size_t max_bytes);
+
+//
+// journal_clear
+//
+// Forgets all records.
+//
+void journal_clear(struct JOURNAL* journal);
+
+//
+// journal_empty
+//
+// Returns true if there are no records to undo.
+//
+bool journal_empty(struct JOURNAL* journal);
+
+//
+// journal_begin
+//
+// Appends a JOURNAL_NO_WRITE record for the statement on the given
+// line, which is about to execute.
+//
+void journal_begin(struct JOURNAL* journal, int line);
+
+//
+// journal_old_value
+//
+// Turns the latest record into a JOURNAL_OLD_VALUE record: the
+// statement is about to overwrite the cell at addr, which holds
+// old_value (strings are copied into the journal).
+//
+void journal_old_value(struct JOURNAL* journal, int addr, const struct RAM_VALUE* old_value);
+
+//
+// journal_old_string
+//
+// Same as journal_old_value() for a string old value held as a rope:
+// the journal takes a reference to old instead of copying it.
+//
+void journal_old_string(struct JOURNAL* journal, int addr, struct ROPE* old);
+
+//
+// journal_new_cell
+//
+// Turns the latest record into a JOURNAL_NEW_CELL record: the
+// statement created the cell at addr.
+//
+void journal_new_cell(struct JOURNAL* journal, int addr);
+
+//
+// journal_pop
+//
+// Removes the latest record and returns it in *record. Returns false
+// if the journal is empty. A string old_value points into the
+// journal and is only valid until the next call on the journal.
+//
+bool journal_pop(struct JOURNAL* journal, struct JOURNAL_RECORD* record);
@@ -0,0 +1,369 @@
+/*lexer.cpp*/
+
+//
+// Scanner for nuPython programs held in memory. See lexer.h.
+//
+// Follows scanner_nextToken() rule for rule, including its quirks: a
+// '.' not followed by a digit is an unknown token, a string literal
+// that runs into the end of the line is cut off there with a
+// warning, and a '$' anywhere outside a string or comment ends the
+// program.
+//
+
+#include <cstdio>
+#include <cstring>
+
+#include "lexer.h"
+
+using namespace std;
+
+
+//
+// Character classes. Every character the scanner can see falls into
+// one class that decides what kind of token it starts, so the scanner
+// needs one table lookup and one switch per token. The classes are
+// the scanner's (the C locale): characters outside ASCII are unknown.
+//
+enum CHAR_CLASSES
+{
+  CC_UNKNOWN = 0,  // not part of nuPython
+  CC_SPACE,        // whitespace other than '\n'
+  CC_NEWLINE,      // '\n'
+  CC_END,          // '$'
+  CC_COMMENT,      // '#'
+  CC_IDENT,        // letter or '_'
+  CC_DIGIT,        // 0-9
+  CC_DOT,          // '.'
+  CC_QUOTE,        // ' or "
+  CC_PUNCT         // operator or punctuation, see token[] and second[]
+};
+
+struct CHAR_TABLE
+{
+  unsigned char cls[256];    // enum CHAR_CLASSES
+  bool          ident[256];  // can appear in an identifier after the first character
+  signed char   token[256];  // CC_PUNCT: token of the character on its own
+  char          second[256]; // CC_PUNCT: character that makes it a two-character operator, or 0
+  signed char   token2[256]; // CC_PUNCT: token of that two-character operator
+};
+
+static constexpr void punct(CHAR_TABLE& table, char c, int id, char second = 0, int id2 = nuPy_UNKNOWN)
+{
+  unsigned char u = (unsigned char) c;
+
+  table.cls[u] = CC_PUNCT;
+  table.token[u] = (signed char) id;
+  table.second[u] = second;
+  table.token2[u] = (signed char) id2;
+}
+
+static constexpr CHAR_TABLE build_char_table()
+{
+  CHAR_TABLE table = {};
+
+  for (int c = 'a'; c <= 'z'; c++) {
+    table.cls[c] = table.cls[c - 'a' + 'A'] = CC_IDENT;
+    table.ident[c] = table.ident[c - 'a' + 'A'] = true;
+  }
+  for (int c = '0'; c <= '9'; c++) {
+    table.cls[c] = CC_DIGIT;
+    table.ident[c] = true;
+  }
+  table.cls['_'] = CC_IDENT;
+  table.ident['_'] = true;
+
+  table.cls[' '] = table.cls['\t'] = table.cls['\v'] = table.cls['\f'] = table.cls['\r'] = CC_SPACE;
+  table.cls['\n'] = CC_NEWLINE;
+  table.cls['$'] = CC_END;
+  table.cls['#'] = CC_COMMENT;
+  table.cls['.'] = CC_DOT;
+  table.cls['\''] = table.cls['"'] = CC_QUOTE;
+
+  punct(table, '(', nuPy_LEFT_PAREN);
+  punct(table, ')', nuPy_RIGHT_PAREN);
+  punct(table, '[', nuPy_LEFT_BRACKET);
+  punct(table, ']', nuPy_RIGHT_BRACKET);
+  punct(table, '{', nuPy_LEFT_BRACE);
+  punct(table, '}', nuPy_RIGHT_BRACE);
+  punct(table, '+', nuPy_PLUS);
+  punct(table, '-', nuPy_MINUS);
+  punct(table, '/', nuPy_SLASH);
+  punct(table, '%', nuPy_PERCENT);
+  punct(table, '&', nuPy_AMPERSAND);
+  punct(table, ':', nuPy_COLON);
+  punct(table, '*', nuPy_ASTERISK, '*', nuPy_POWER);
+  punct(table, '=', nuPy_EQUAL, '=', nuPy_EQUALEQUAL);
+  punct(table, '!', nuPy_UNKNOWN, '=', nuPy_NOTEQUAL);
+  punct(table, '<', nuPy_LT, '=', nuPy_LTE);
+  punct(table, '>', nuPy_GT, '=', nuPy_GTE);
+
+  return table;
+}
+
+static constexpr CHAR_TABLE chars = build_char_table();
+
+
+//
+// Keywords, in TokenID order: keywords[k] is the spelling of token
+// nuPy_KEYW_AND + k.
+//
+static constexpr const char* keywords[] = {
+  "and", "break", "continue", "def", "elif", "else", "False", "for",
+  "if", "in", "is", "None", "not", "or", "pass", "return", "True",
+  "while"
+};
+
+static constexpr int NUM_KEYWORDS = (int) (sizeof(keywords) / sizeof(keywords[0]));
+
+static_assert(NUM_KEYWORDS == nuPy_KEYW_WHILE - nuPy_KEYW_AND + 1,
+  "keywords[] must have a spelling for every keyword in enum TokenID");
+
+//
+// A perfect hash of the keywords: a hash of an identifier's first and
+// last characters and its length picks the one keyword it could be,
+// so an identifier is compared against at most one keyword. The seed
+// that makes the hash collision-free is found at compile time.
+//
+#define KEYWORD_SLOTS 64  // a power of 2
+
+static constexpr unsigned keyword_hash(const char* s, size_t length, unsigned seed)
+{
+  return ((unsigned char) s[0] * seed + (unsigned char) s[length - 1] * 31u + (unsigned) length * 7u)
+    & (KEYWORD_SLOTS - 1);
+}
+
+struct KEYWORD_TABLE
+{
+  unsigned      seed;                  // 0 if no seed was found
+  signed char   slot[KEYWORD_SLOTS];   // keyword in each slot, -1 if none
+  unsigned char length[NUM_KEYWORDS];  // strlen of each keyword
+  size_t        shortest, longest;
+};
+
+static constexpr KEYWORD_TABLE build_keyword_table()
+{
+  KEYWORD_TABLE table = {};
+
+  table.shortest = 1000;
+
+  for (int k = 0; k < NUM_KEYWORDS; k++) {
+    size_t n = 0;
+    while (keywords[k][n] != '\0')
+      n++;
+
+    table.length[k] = (unsigned char) n;
+    if (n < table.shortest) table.shortest = n;
+    if (n > table.longest) table.longest = n;
+  }
+
+  for (unsigned seed = 1; seed < 10000; seed++) {
+    for (int i = 0; i < KEYWORD_SLOTS; i++)
+      table.slot[i] = -1;
+
+    bool collision = false;
+
+    for (int k = 0; k < NUM_KEYWORDS && !collision; k++) {
+      unsigned h = keyword_hash(keywords[k], table.length[k], seed);
+
+      if (table.slot[h] >= 0)
+        collision = true;
+      else
+        table.slot[h] = (signed char) k;
+    }
+
+    if (!collision) {
+      table.seed = seed;
+      return table;
+    }
+  }
+
+  return table;
+}
+
+static constexpr KEYWORD_TABLE keyword_table = build_keyword_table();
+
+static_assert(keyword_table.seed != 0, "no perfect hash found for the keywords, try more KEYWORD_SLOTS");
+
+
+//
+// id_or_keyword
+//
+// The token of an identifier: nuPy_IDENTIFIER, or its keyword.
+//
+static inline int id_or_keyword(const char* s, size_t length)
+{
+  if (length < keyword_table.shortest || length > keyword_table.longest)
+    return nuPy_IDENTIFIER;
+
+  int k = keyword_table.slot[keyword_hash(s, length, keyword_table.seed)];
+
+  if (k >= 0 && keyword_table.length[k] == length && memcmp(keywords[k], s, length) == 0)
+    return nuPy_KEYW_AND + k;
+
+  return nuPy_IDENTIFIER;
+}
+
+
+//
+// lexer_init
+//
+void lexer_init(struct LEXER* lexer, const char* text, size_t length)
+{
+  lexer->next = text;
+  lexer->end = text + length;
+  lexer->line = 1;
+  lexer->col = 1;
+}
+
+
+//
+// lexer_nextToken
+//
+struct Token lexer_nextToken(struct LEXER* lexer, const char** value, size_t* length)
+{
+  const char* p = lexer->next;
+  const char* end = lexer->end;
+
+  struct Token token;
+
+  while (true)
+  {
+    token.line = lexer->line;
+    token.col = lexer->col;
+
+    int cls = (p == end) ? CC_END : chars.cls[(unsigned char) *p];
+
+    if (cls == CC_END) {
+      //
+      // end of the program, which stays put:
+      //
+      token.id = nuPy_EOS;
+      *value = "$";
+      *length = 1;
+      break;
+    }
+
+    const char* start = p++;
+
+    switch (cls)
+    {
+      case CC_SPACE:
+        lexer->col++;
+        continue;
+
+      case CC_NEWLINE:
+        token.id = nuPy_EOLN;
+        *value = "EOLN";
+        *length = 4;
+
+        lexer->line++;
+        lexer->col = 1;
+        break;
+
+      case CC_COMMENT: {
+        //
+        // up to (not including) the end of the line:
+        //
+        const char* eoln = (const char*) memchr(p, '\n', end - p);
+        if (eoln == NULL)
+          eoln = end;
+
+        lexer->col += (int) (eoln - start);
+        p = eoln;
+        continue;
+      }
+
+      case CC_IDENT:
+        while (p < end && chars.ident[(unsigned char) *p])
+          p++;
+
+        token.id = id_or_keyword(start, p - start);
+        break;
+
+      case CC_DIGIT:
+        //
+        // 123, 3.14 or 89.
+        //
+        while (p < end && chars.cls[(unsigned char) *p] == CC_DIGIT)
+          p++;
+
+        if (p < end && *p == '.') {
+          p++;
+          while (p < end && chars.cls[(unsigned char) *p] == CC_DIGIT)
+            p++;
+          token.id = nuPy_REAL_LITERAL;
+        }
+        else
+          token.id = nuPy_INT_LITERAL;
+        break;
+
+      case CC_DOT:
+        //
+        // .5, or a '.' that doesn't start a number (a token of its
+        // own, unknown):
+        //
+        if (p < end && chars.cls[(unsigned char) *p] == CC_DIGIT) {
+          while (p < end && chars.cls[(unsigned char) *p] == CC_DIGIT)
+            p++;
+          token.id = nuPy_REAL_LITERAL;
+        }
+        else
+          token.id = nuPy_UNKNOWN;
+        break;
+
+      case CC_QUOTE: {
+        //
+        // string literal, the value is what's between the quotes:
+        //
+        const char* close = p;
+        while (close < end && *close != *start && *close != '\n')
+          close++;
+
+        *value = p;
+        *length = close - p;
+        lexer->col += 1 + (int) *length;
+
+        if (close == end || *close == '\n') {
+          printf("**WARNING: string literal @ (%d, %d) not terminated properly\n", token.line, token.col);
+          p = close;
+        }
+        else {
+          p = close + 1;  // past the closing quote
+          lexer->col++;
+        }
+
+        token.id = nuPy_STR_LITERAL;
+        break;
+      }
+
+      case CC_PUNCT: {
+        //
+        // * = ! < > may be followed by a second character:
+        //
+        unsigned char c = (unsigned char) *start;
+
+        if (chars.second[c] != 0 && p < end && *p == chars.second[c]) {
+          p++;
+          token.id = chars.token2[c];
+        }
+        else
+          token.id = chars.token[c];
+        break;
+      }
+
+      default:  // CC_UNKNOWN
+        token.id = nuPy_UNKNOWN;
+        break;
+    }
+
+    if (token.id != nuPy_EOLN && token.id != nuPy_STR_LITERAL) {
+      *value = start;
+      *length = p - start;
+      lexer->col += (int) *length;
+    }
+    break;
+  }
+
+  lexer->next = p;
+  return token;
+}
@@ -0,0 +1,50 @@
+/*lexer.h*/
+
+//
+// Scanner for nuPython programs held in memory. Produces exactly the
+// tokens scanner_nextToken() does, with the same line and column
+// numbers and warnings, but reads a contiguous buffer instead of a
+// FILE* one character at a time: lookahead is just looking at the
+// next byte, and a token's value is returned as a pointer into the
+// buffer rather than copied out.
+//
+
+#pragma once
+
+#include <stddef.h>
+
+#include "token.h"
+
+
+struct LEXER
+{
+  const char* next;  // next character to scan
+  const char* end;   // end of the buffer
+  int line;          // line of next (1-based)
+  int col;           // column of next (1-based)
+};
+
+
+//
+// Public functions:
+//
+
+//
+// lexer_init
+//
+// Starts scanning the length characters at text, which must stay
+// unchanged while the lexer is in use.
+//
+void lexer_init(struct LEXER* lexer, const char* text, size_t length);
+
+//
+// lexer_nextToken
+//
+// Returns the next token, the way scanner_nextToken() does, and sets
+// *value and *length to the token's value: the characters of the
+// token (for a string literal, without the quotes), "EOLN" for an
+// end-of-line, and "$" for the end of the program. The value is not
+// NUL terminated; it points into the buffer or to a constant string.
+// Once the end of the program is reached, every call returns it.
+//
+struct Token lexer_nextToken(struct LEXER* lexer, const char** value, size_t* length);
@@ -7,6 +7,44 @@
 //
 //     ./a.out test.py
 //
+// By default the program graph is executed directly via execute().
+// Pass -vm before the filename to compile the program to bytecode
+// and debug it on the VM engine instead:
+//
+//     ./a.out -vm test.py
+//
+// Pass -O to also build an optimized program
+// graph (see optimize.h), which is what runs whenever nothing can
+// stop the run: no breakpoints, no watches and the journal off --
+// which it starts as, so r runs the optimized program to the end
+// until breakpoints or watches are set or the journal is turned on:
+//
+//     ./a.out -O test.py
+//
+// Pass -batch and a script file to run the debugger commands in
+// the script (input() reads from the script too) instead of the
+// keyboard. The prompts are left out and output is written in
+// large blocks rather than line by line, so scripted runs of many
+// commands aren't held up by the console:
+//
+//     ./a.out -batch commands.txt test.py
+//
+// Pass -types to have the statements that are certain to fail (see
+// infer.h) reported before the program runs:
+//
+//     ./a.out -types test.py
+//
+// The flags can be combined, in any order, as long as they come
+// before the filename:
+//
+//     ./a.out -batch commands.txt -O -vm test.py
+//
+// The program is parsed from memory: a file is mapped rather than
+// read a character at a time, so even very large (say, generated)
+// programs parse quickly. The program graph is built as the program
+// is parsed, into one arena, so building it and freeing it at exit
+// are quick too.
+//
 // Or you can just run the debugger and enter the nuPython program
 // manually; enter $ to denote the end of the input program. Then 
 // you can debug.
@@ -30,6 +68,12 @@
 #include "programgraph.h" 
 #include "ram.h"
 #include "execute.h"
+#include "vm.h"
+#include "source.h"
+#include "syntax.h"
+#include "graph.h"
+#include "infer.h"
+#include "optimize.h"
 
 #include "debugger.h"
 
@@ -39,16 +83,70 @@ using namespace std;
 //
 // main
 //
-// usage: ./a.out [filename.py]
+// usage: ./a.out [-vm] [-O] [-batch script] [filename.py]
 // 
 // If a filename is given, the file is opened and serves as
 // input to the debugger. If a filename is not given, then 
-// input is taken from the keyboard until $ is input.
+// input is taken from the keyboard until $ is input. -vm 
+// selects the bytecode VM as the execution engine, -O runs an
+// optimized program graph when possible, -batch reads the 
+// debugger commands from a script.
 //
 int main(int argc, char* argv[])
 {
-  FILE* input = NULL;
+  struct SOURCE* input = NULL;
   bool  keyboardInput = false;
+  bool  useVM = false;
+  bool  optimize = false;
+  bool  batch = false;
+  bool  reportTypes = false;
+
+  //
+  // flags, in any order before the filename:
+  //
+  while (argc > 1) {
+    string flag = argv[1];
+
+    if (flag == "-vm") {  // execution engine
+      useVM = true;
+      argc--;
+      argv++;
+    }
+    else if (flag == "-O") {  // optimizer
+      optimize = true;
+      argc--;
+      argv++;
+    }
+    else if (flag == "-types") {  // type inference report
+      reportTypes = true;
+      argc--;
+      argv++;
+    }
+    else if (flag == "-batch" && argc > 2) {
+      //
+      // batch mode: the script becomes stdin, so commands and the
+      // program's input() calls come from it in order, and stdout
+      // gets a large buffer that is only written when full (or at
+      // exit) -- this has to happen before anything is output:
+      //
+      if (freopen(argv[2], "r", stdin) == nullptr) {
+        cout << "**ERROR: unable to open script file '"
+             << argv[2]
+             << "' for input." << endl;
+
+        return 0;
+      }
+
+      setvbuf(stdout, nullptr, _IOFBF, 1 << 20);
+      cin.tie(nullptr);  // don't flush before reading each command
+
+      batch = true;
+      argc -= 2;
+      argv += 2;
+    }
+    else
+      break;
+  }
 
   //
   // where is the input coming from?
@@ -57,7 +155,6 @@ int main(int argc, char* argv[])
     //
     // no args, just the program name:
     //
-    input = stdin;
     keyboardInput = true;
   }
   else {
@@ -66,7 +163,7 @@ int main(int argc, char* argv[])
     //
     char* filename = argv[1];
 
-    input = fopen(filename, "r");
+    input = source_open(filename);
 
     if (input == nullptr) // unable to open:
     {
@@ -83,14 +180,29 @@ int main(int argc, char* argv[])
   if (keyboardInput)  // prompt the user if appropriate:
   {
     cout << "nuPython input (enter $ when you're done)>" << endl;
+
+    input = source_read_stdin();
+
+    if (input == nullptr)
+    {
+      cout << "**ERROR: out of memory reading the program." << endl;
+
+      return 0;
+    }
   }
 
   //
-  // call parser to check program syntax:
+  // call parser to check program syntax, which builds the program
+  // graph as it goes:
   //
-  struct TokenQueue* tokens = parser_parse(input);
+  struct PROGRAM_GRAPH* graph = syntax_parse(input->text, input->length);
 
-  if (tokens == nullptr)
+  //
+  // the graph has its own copy of what it needs from the program text:
+  //
+  source_destroy(input);
+
+  if (graph == nullptr)
   {
     // 
     // program has a syntax error, error msg already output:
@@ -101,35 +213,92 @@ int main(int argc, char* argv[])
   {
     //
     // we have a valid program in terms of syntax, so let's
-    // build the program graph and start debugging:
+    // make sure we have its whole program graph and start 
+    // debugging:
     //
     cout << "**parsing successful" << endl;
     cout << "**building program graph" << endl;
     cout << endl;
 
-    struct STMT* program = programgraph_build(tokens);
+    graph_check(graph);
+
+    struct STMT* program = graph->program;
 
     // programgraph_print(program);
 
+    //
+    // infer the types of variables and expressions, and with -types
+    // report the statements that are certain to fail before anything
+    // runs:
+    //
+    struct INFERENCE* inference = infer_types(program);
+
+    if (reportTypes)
+      infer_report(inference);
+
+    //
+    // compile to bytecode if the VM engine was requested; NULL 
+    // means the program uses something the VM doesn't handle,
+    // in which case we fall back to execute():
+    //
+    struct VM_PROGRAM* vm = nullptr;
+
+    if (useVM) {
+      vm = vm_compile(program, inference);
+
+      if (vm == nullptr)
+        cout << "**the VM doesn't handle this program, using execute() instead" << endl << endl;
+    }
+
+    infer_destroy(inference);
+
+    //
+    // build the optimized program graph if asked to, and compile it
+    // too on the VM; NULL means the program isn't optimized:
+    //
+    struct OPTIMIZED_PROGRAM* optimized = nullptr;
+    struct VM_PROGRAM* vmOptimized = nullptr;
+
+    if (optimize)
+      optimized = optimize_program(program);
+
+    if (optimized != nullptr && vm != nullptr) {
+      struct STMT* optimizedProgram = optimize_entry(optimized, program);
+      struct INFERENCE* optimizedInference = infer_types(optimizedProgram);
+
+      vmOptimized = vm_compile(optimizedProgram, optimizedInference);
+
+      infer_destroy(optimizedInference);
+
+      if (vmOptimized == nullptr) {
+        optimize_destroy(optimized);
+        optimized = nullptr;
+      }
+    }
+
     //
     // now debug the program:
     //
-    Debugger debugger(program);
+    Debugger debugger(program, vm, batch, optimized, vmOptimized);
     
     debugger.run();
 
     //
     // debugger has finished, free data structures:
     //
-    programgraph_destroy(program);
-    tokenqueue_destroy(tokens);
+    if (vm != nullptr)
+      vm_destroy(vm);
+
+    if (vmOptimized != nullptr)
+      vm_destroy(vmOptimized);
+
+    optimize_destroy(optimized);
+
+    graph_destroy(graph);
   }
 
   //
   // done:
   //
-  if (!keyboardInput)
-    fclose(input);
-
   return 0;
 }
@@ -0,0 +1,728 @@
+/*optimize.cpp*/
+
+//
+// Optimizer for nuPython program graphs. See optimize.h.
+//
+// Three passes over the original graph:
+//
+//   1. Forward, the way execution goes, carrying what is known about
+//      each variable: the literal it holds, or the variable it is a
+//      copy of. Reads are replaced by what they're known to be, and
+//      expressions whose operands end up literals are folded. Every
+//      statement gets a copy, with a new expression if it changed;
+//      nodes that didn't change are shared with the original graph.
+//      Nothing is known at the top of a while loop about the
+//      variables its body assigns.
+//   2. Backward over the statements of each body (the program, or a
+//      loop body), finding the dead stores.
+//   3. Linking the copies of the statements that are left.
+//
+// Folding computes what execute() would, with the same arithmetic,
+// and only where execute() would not fail: operands of the wrong
+// types, a division by zero, or a result that doesn't fit its
+// literal (an int power out of range, an infinite real) are left to
+// execute().
+//
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <climits>
+
+#include "optimize.h"
+#include "graph.h"
+#include "arena.h"
+
+using namespace std;
+
+
+typedef unordered_set<string_view> NAMES;
+
+//
+// what is known about the variables at some point of the program:
+//
+struct FACTS
+{
+  unordered_map<string_view, ELEMENT*> known;              // variable -> literal it holds or identifier it copies
+  unordered_map<string_view, vector<string_view>> copies;  // variable -> variables that were copied from it
+};
+
+struct OPTIMIZED_PROGRAM
+{
+  PROGRAM_GRAPH* graph;                   // the optimized graph and its new nodes
+
+  unordered_map<STMT*, STMT*> copies;     // original stmt -> its copy
+  unordered_map<STMT*, STMT*> originals;  // copy -> original stmt
+
+  unordered_set<STMT*> existing;          // assignments to a variable already assigned
+  unordered_set<STMT*> dead;              // original stmts that were dropped
+  vector<vector<STMT*>> bodies;           // the stmts of each body, in order
+};
+
+
+//
+// new nodes, from the optimized graph's arena:
+//
+template<typename T>
+static inline T* alloc(OPTIMIZED_PROGRAM* optimized)
+{
+  return (T*) arena_alloc(optimized->graph->arena, sizeof(T));
+}
+
+static ELEMENT* new_literal(OPTIMIZED_PROGRAM* optimized, int element_type, const char* text, size_t length)
+{
+  ELEMENT* element = alloc<ELEMENT>(optimized);
+
+  element->element_type = element_type;
+  element->element_value = arena_copy(optimized->graph->arena, text, length);
+
+  return element;
+}
+
+static ELEMENT* new_int(OPTIMIZED_PROGRAM* optimized, int value)
+{
+  char text[16];
+  int length = snprintf(text, sizeof(text), "%d", value);
+
+  return new_literal(optimized, ELEMENT_INT_LITERAL, text, length);
+}
+
+static ELEMENT* new_real(OPTIMIZED_PROGRAM* optimized, double value)
+{
+  //
+  // 17 significant digits read back as exactly the same double:
+  //
+  char text[32];
+  int length = snprintf(text, sizeof(text), "%.17g", value);
+
+  return new_literal(optimized, ELEMENT_REAL_LITERAL, text, length);
+}
+
+static ELEMENT* new_boolean(OPTIMIZED_PROGRAM* optimized, bool value)
+{
+  return value ? new_literal(optimized, ELEMENT_TRUE, "True", 4)
+               : new_literal(optimized, ELEMENT_FALSE, "False", 5);
+}
+
+//
+// An expression with just the given element (rhs == NULL), or the
+// given binary operation.
+//
+static EXPR* new_expr(OPTIMIZED_PROGRAM* optimized, ELEMENT* lhs, int oper, ELEMENT* rhs)
+{
+  EXPR* expr = alloc<EXPR>(optimized);
+
+  expr->lhs = alloc<UNARY_EXPR>(optimized);
+  expr->lhs->expr_type = UNARY_ELEMENT;
+  expr->lhs->element = lhs;
+
+  expr->isBinaryExpr = (rhs != NULL);
+  expr->operator_type = (rhs != NULL) ? oper : OPERATOR_NO_OP;
+  expr->rhs = NULL;
+
+  if (rhs != NULL) {
+    expr->rhs = alloc<UNARY_EXPR>(optimized);
+    expr->rhs->expr_type = UNARY_ELEMENT;
+    expr->rhs->element = rhs;
+  }
+
+  return expr;
+}
+
+
+//
+// constant folding
+//
+static bool is_literal(ELEMENT* element)
+{
+  switch (element->element_type)
+  {
+  case ELEMENT_INT_LITERAL:
+  case ELEMENT_REAL_LITERAL:
+  case ELEMENT_STR_LITERAL:
+  case ELEMENT_TRUE:
+  case ELEMENT_FALSE:
+    return true;
+  default:
+    return false;
+  }
+}
+
+static bool is_number(ELEMENT* element)
+{
+  return element->element_type == ELEMENT_INT_LITERAL || element->element_type == ELEMENT_REAL_LITERAL;
+}
+
+static bool is_comparison(int oper)
+{
+  return oper >= OPERATOR_EQUAL && oper <= OPERATOR_GTE;
+}
+
+template<typename T>
+static bool compare(T lhs, int oper, T rhs)
+{
+  switch (oper)
+  {
+  case OPERATOR_EQUAL:     return lhs == rhs;
+  case OPERATOR_NOT_EQUAL: return lhs != rhs;
+  case OPERATOR_LT:        return lhs < rhs;
+  case OPERATOR_LTE:       return lhs <= rhs;
+  case OPERATOR_GT:        return lhs > rhs;
+  default:                 return lhs >= rhs;
+  }
+}
+
+//
+// Same as perform_int_operation for the operations that can't fail;
+// + - * wrap around, as they do there. Returns NULL if it can.
+//
+static ELEMENT* fold_int(OPTIMIZED_PROGRAM* optimized, int lhs, int oper, int rhs)
+{
+  if (is_comparison(oper))
+    return new_boolean(optimized, compare(lhs, oper, rhs));
+
+  switch (oper)
+  {
+  case OPERATOR_PLUS:
+    return new_int(optimized, (int) ((unsigned) lhs + (unsigned) rhs));
+  case OPERATOR_MINUS:
+    return new_int(optimized, (int) ((unsigned) lhs - (unsigned) rhs));
+  case OPERATOR_ASTERISK:
+    return new_int(optimized, (int) ((unsigned) lhs * (unsigned) rhs));
+  case OPERATOR_POWER: {
+    double result = pow((double) lhs, (double) rhs);
+
+    if (!(result >= INT_MIN && result <= INT_MAX))
+      return NULL;
+
+    return new_int(optimized, (int) result);
+  }
+  case OPERATOR_MOD:
+  case OPERATOR_DIV:
+    if (rhs == 0 || (lhs == INT_MIN && rhs == -1))
+      return NULL;
+
+    return new_int(optimized, (oper == OPERATOR_MOD) ? lhs % rhs : lhs / rhs);
+  default:
+    return NULL;
+  }
+}
+
+//
+// Same as perform_real_operation; NULL if the result isn't finite.
+//
+static ELEMENT* fold_real(OPTIMIZED_PROGRAM* optimized, double lhs, int oper, double rhs)
+{
+  if (is_comparison(oper))
+    return new_boolean(optimized, compare(lhs, oper, rhs));
+
+  double result;
+
+  switch (oper)
+  {
+  case OPERATOR_PLUS:     result = lhs + rhs; break;
+  case OPERATOR_MINUS:    result = lhs - rhs; break;
+  case OPERATOR_ASTERISK: result = lhs * rhs; break;
+  case OPERATOR_POWER:    result = pow(lhs, rhs); break;
+  case OPERATOR_MOD:      result = fmod(lhs, rhs); break;
+  case OPERATOR_DIV:      result = lhs / rhs; break;
+  default:
+    return NULL;
+  }
+
+  if (!isfinite(result))
+    return NULL;
+
+  return new_real(optimized, result);
+}
+
+//
+// Same as perform_str_operation: + concatenates, comparisons compare.
+//
+static ELEMENT* fold_str(OPTIMIZED_PROGRAM* optimized, const char* lhs, int oper, const char* rhs)
+{
+  if (is_comparison(oper))
+    return new_boolean(optimized, compare(strcmp(lhs, rhs), oper, 0));
+
+  if (oper != OPERATOR_PLUS)
+    return NULL;
+
+  string result = string(lhs) + rhs;
+
+  return new_literal(optimized, ELEMENT_STR_LITERAL, result.data(), result.size());
+}
+
+//
+// Returns the literal lhs oper rhs evaluates to, or NULL if either
+// isn't a literal or evaluating it could fail.
+//
+static ELEMENT* fold(OPTIMIZED_PROGRAM* optimized, ELEMENT* lhs, int oper, ELEMENT* rhs)
+{
+  if (!is_literal(lhs) || !is_literal(rhs))
+    return NULL;
+
+  if (lhs->element_type == ELEMENT_STR_LITERAL && rhs->element_type == ELEMENT_STR_LITERAL)
+    return fold_str(optimized, lhs->element_value, oper, rhs->element_value);
+
+  if (!is_number(lhs) || !is_number(rhs))
+    return NULL;
+
+  if (lhs->element_type == ELEMENT_INT_LITERAL && rhs->element_type == ELEMENT_INT_LITERAL)
+    return fold_int(optimized, atoi(lhs->element_value), oper, atoi(rhs->element_value));
+
+  double left = (lhs->element_type == ELEMENT_INT_LITERAL) ? (double) atoi(lhs->element_value)
+                                                            : atof(lhs->element_value);
+  double right = (rhs->element_type == ELEMENT_INT_LITERAL) ? (double) atoi(rhs->element_value)
+                                                             : atof(rhs->element_value);
+
+  return fold_real(optimized, left, oper, right);
+}
+
+
+//
+// copy propagation
+//
+static ELEMENT* propagate(FACTS& facts, ELEMENT* element)
+{
+  if (element->element_type != ELEMENT_IDENTIFIER)
+    return element;
+
+  auto found = facts.known.find(element->element_value);
+
+  return (found != facts.known.end()) ? found->second : element;
+}
+
+//
+// The variable is assigned: forget what it held, and which variables
+// were copies of it.
+//
+static void forget(FACTS& facts, string_view var)
+{
+  facts.known.erase(var);
+
+  auto found = facts.copies.find(var);
+
+  if (found == facts.copies.end())
+    return;
+
+  for (string_view copy : found->second) {
+    auto fact = facts.known.find(copy);
+
+    if (fact != facts.known.end() && fact->second->element_type == ELEMENT_IDENTIFIER &&
+        var == fact->second->element_value)
+      facts.known.erase(fact);
+  }
+
+  facts.copies.erase(found);
+}
+
+static void learn(FACTS& facts, string_view var, ELEMENT* value)
+{
+  if (value->element_type == ELEMENT_IDENTIFIER) {
+    if (var == value->element_value)  // x = x
+      return;
+
+    facts.copies[value->element_value].push_back(var);
+  }
+  else if (!is_literal(value))
+    return;
+
+  facts.known[var] = value;
+}
+
+//
+// Rewrites an expression with what is known: sets *result to the new
+// expression (expr itself if nothing changed) and *value to the
+// element the expression is known to evaluate to, NULL if none.
+// Returns false for unary operators, which aren't optimized.
+//
+static bool optimize_expr(OPTIMIZED_PROGRAM* optimized, FACTS& facts, EXPR* expr, EXPR** result, ELEMENT** value)
+{
+  if (expr->lhs->expr_type != UNARY_ELEMENT)
+    return false;
+
+  if (expr->isBinaryExpr && expr->rhs->expr_type != UNARY_ELEMENT)
+    return false;
+
+  ELEMENT* lhs = propagate(facts, expr->lhs->element);
+
+  if (!expr->isBinaryExpr) {
+    *value = lhs;
+    *result = (lhs == expr->lhs->element) ? expr : new_expr(optimized, lhs, OPERATOR_NO_OP, NULL);
+    return true;
+  }
+
+  ELEMENT* rhs = propagate(facts, expr->rhs->element);
+  ELEMENT* folded = fold(optimized, lhs, expr->operator_type, rhs);
+
+  if (folded != NULL) {
+    *value = folded;
+    *result = new_expr(optimized, folded, OPERATOR_NO_OP, NULL);
+    return true;
+  }
+
+  *value = NULL;
+  *result = (lhs == expr->lhs->element && rhs == expr->rhs->element)
+    ? expr : new_expr(optimized, lhs, expr->operator_type, rhs);
+
+  return true;
+}
+
+//
+// Adds the variables assigned in the given body to names. Returns
+// false if the body has a statement that isn't optimized.
+//
+static bool assigned_in(STMT* stmt, STMT* loop, NAMES& names)
+{
+  while (stmt != NULL && stmt != loop)
+  {
+    switch (stmt->stmt_type)
+    {
+    case STMT_ASSIGNMENT:
+      if (stmt->types.assignment->isPtrDeref)
+        return false;
+
+      names.insert(stmt->types.assignment->var_name);
+      stmt = stmt->types.assignment->next_stmt;
+      break;
+    case STMT_FUNCTION_CALL:
+      stmt = stmt->types.function_call->next_stmt;
+      break;
+    case STMT_WHILE_LOOP:
+      if (!assigned_in(stmt->types.while_loop->loop_body, stmt, names))
+        return false;
+
+      stmt = stmt->types.while_loop->next_stmt;
+      break;
+    case STMT_PASS:
+      stmt = stmt->types.pass->next_stmt;
+      break;
+    default:
+      return false;
+    }
+  }
+
+  return true;
+}
+
+//
+// Pass 1 over a body, which ends at loop (the while loop it is the
+// body of) or NULL. defined holds the variables certain to have been
+// assigned. Returns false if the program can't be optimized.
+//
+static bool optimize_body(OPTIMIZED_PROGRAM* optimized, STMT* stmt, STMT* loop, FACTS& facts, NAMES& defined)
+{
+  vector<STMT*> body;
+
+  while (stmt != NULL && stmt != loop)
+  {
+    body.push_back(stmt);
+
+    STMT* copy = alloc<STMT>(optimized);
+    *copy = *stmt;
+
+    optimized->copies[stmt] = copy;
+    optimized->originals[copy] = stmt;
+
+    if (stmt->stmt_type == STMT_ASSIGNMENT) {
+      struct STMT_ASSIGNMENT* assignment = stmt->types.assignment;
+
+      if (assignment->isPtrDeref)
+        return false;
+
+      copy->types.assignment = alloc<struct STMT_ASSIGNMENT>(optimized);
+      *copy->types.assignment = *assignment;
+
+      string_view var = assignment->var_name;
+      ELEMENT* value = NULL;
+
+      if (assignment->rhs->value_type == VALUE_EXPR) {
+        EXPR* expr;
+
+        if (!optimize_expr(optimized, facts, assignment->rhs->types.expr, &expr, &value))
+          return false;
+
+        if (expr != assignment->rhs->types.expr) {
+          VALUE* rhs = alloc<VALUE>(optimized);
+
+          rhs->value_type = VALUE_EXPR;
+          rhs->types.expr = expr;
+          copy->types.assignment->rhs = rhs;
+        }
+      }
+
+      if (defined.count(var) > 0)
+        optimized->existing.insert(stmt);
+
+      forget(facts, var);
+
+      if (value != NULL)
+        learn(facts, var, value);
+
+      defined.insert(var);
+      stmt = assignment->next_stmt;
+    }
+    else if (stmt->stmt_type == STMT_FUNCTION_CALL) {
+      struct STMT_FUNCTION_CALL* call = stmt->types.function_call;
+
+      copy->types.function_call = alloc<struct STMT_FUNCTION_CALL>(optimized);
+      *copy->types.function_call = *call;
+
+      if (call->parameter != NULL && strcmp(call->function_name, "print") == 0)
+        copy->types.function_call->parameter = propagate(facts, call->parameter);
+
+      stmt = call->next_stmt;
+    }
+    else if (stmt->stmt_type == STMT_WHILE_LOOP) {
+      struct STMT_WHILE_LOOP* while_loop = stmt->types.while_loop;
+
+      copy->types.while_loop = alloc<struct STMT_WHILE_LOOP>(optimized);
+      *copy->types.while_loop = *while_loop;
+
+      //
+      // the condition and the body see what holds on every iteration,
+      // so nothing about what the body assigns:
+      //
+      NAMES assigned;
+
+      if (!assigned_in(while_loop->loop_body, stmt, assigned))
+        return false;
+
+      for (string_view var : assigned)
+        forget(facts, var);
+
+      EXPR* condition;
+      ELEMENT* value;
+
+      if (!optimize_expr(optimized, facts, while_loop->condition, &condition, &value))
+        return false;
+
+      copy->types.while_loop->condition = condition;
+
+      //
+      // the body only learns and forgets about the variables it
+      // assigns, so forgetting them again afterwards leaves what held
+      // before it; and the variables it assigns first may never be:
+      //
+      vector<string_view> undefined;
+
+      for (string_view var : assigned)
+        if (defined.count(var) == 0)
+          undefined.push_back(var);
+
+      if (!optimize_body(optimized, while_loop->loop_body, stmt, facts, defined))
+        return false;
+
+      for (string_view var : assigned)
+        forget(facts, var);
+
+      for (string_view var : undefined)
+        defined.erase(var);
+
+      stmt = while_loop->next_stmt;
+    }
+    else if (stmt->stmt_type == STMT_PASS) {
+      copy->types.pass = alloc<struct STMT_PASS>(optimized);
+      *copy->types.pass = *stmt->types.pass;
+
+      stmt = stmt->types.pass->next_stmt;
+    }
+    else {
+      return false;  // if statement
+    }
+  }
+
+  optimized->bodies.push_back(move(body));
+
+  return true;
+}
+
+
+//
+// dead store elimination
+//
+
+//
+// A statement that can't fail and reads no variable: pass, print()
+// of nothing or a literal, or the store of a literal.
+//
+static bool is_safe(STMT* copy)
+{
+  switch (copy->stmt_type)
+  {
+  case STMT_PASS:
+    return true;
+  case STMT_FUNCTION_CALL: {
+    struct STMT_FUNCTION_CALL* call = copy->types.function_call;
+
+    return strcmp(call->function_name, "print") == 0 &&
+      (call->parameter == NULL || is_literal(call->parameter));
+  }
+  case STMT_ASSIGNMENT: {
+    struct STMT_ASSIGNMENT* assignment = copy->types.assignment;
+
+    if (assignment->rhs->value_type != VALUE_EXPR)
+      return false;
+
+    EXPR* expr = assignment->rhs->types.expr;
+
+    return !expr->isBinaryExpr && expr->lhs->expr_type == UNARY_ELEMENT && is_literal(expr->lhs->element);
+  }
+  default:
+    return false;
+  }
+}
+
+//
+// Pass 2 over a body: walking it backward, a store is dead if a
+// later store to the same variable comes before anything that could
+// read it or fail. The variable must already exist, so that memory
+// looks the same without the store.
+//
+static void find_dead_stores(OPTIMIZED_PROGRAM* optimized, vector<STMT*>& body)
+{
+  unordered_map<string_view, size_t> overwritten;  // variable -> run it is stored again in
+  size_t run = 1;
+
+  for (size_t i = body.size(); i-- > 0; )
+  {
+    STMT* stmt = body[i];
+    STMT* copy = optimized->copies[stmt];
+
+    if (!is_safe(copy)) {
+      run++;
+      continue;
+    }
+
+    if (copy->stmt_type != STMT_ASSIGNMENT)
+      continue;
+
+    string_view var = copy->types.assignment->var_name;
+    auto found = overwritten.find(var);
+
+    if (found != overwritten.end() && found->second == run && optimized->existing.count(stmt) > 0)
+      optimized->dead.insert(stmt);
+    else
+      overwritten[var] = run;
+  }
+}
+
+
+//
+// linking the copies
+//
+static STMT* next_of(STMT* stmt)
+{
+  switch (stmt->stmt_type)
+  {
+  case STMT_ASSIGNMENT:    return stmt->types.assignment->next_stmt;
+  case STMT_FUNCTION_CALL: return stmt->types.function_call->next_stmt;
+  case STMT_WHILE_LOOP:    return stmt->types.while_loop->next_stmt;
+  default:                 return stmt->types.pass->next_stmt;
+  }
+}
+
+static STMT* survivor(OPTIMIZED_PROGRAM* optimized, STMT* stmt)
+{
+  while (stmt != NULL && optimized->dead.count(stmt) > 0)
+    stmt = next_of(stmt);
+
+  return (stmt != NULL) ? optimized->copies[stmt] : NULL;
+}
+
+static void link_copies(OPTIMIZED_PROGRAM* optimized)
+{
+  for (auto& [stmt, copy] : optimized->copies)
+  {
+    if (optimized->dead.count(stmt) > 0)  // unreachable, and linking it would walk the dead stmts after it again
+      continue;
+
+    STMT* next = survivor(optimized, next_of(stmt));
+
+    switch (copy->stmt_type)
+    {
+    case STMT_ASSIGNMENT:
+      copy->types.assignment->next_stmt = next;
+      break;
+    case STMT_FUNCTION_CALL:
+      copy->types.function_call->next_stmt = next;
+      break;
+    case STMT_WHILE_LOOP:
+      copy->types.while_loop->next_stmt = next;
+      copy->types.while_loop->loop_body = survivor(optimized, stmt->types.while_loop->loop_body);
+      break;
+    default:
+      copy->types.pass->next_stmt = next;
+      break;
+    }
+  }
+}
+
+
+//
+// Public functions:
+//
+
+//
+// optimize_program
+//
+struct OPTIMIZED_PROGRAM* optimize_program(struct STMT* program)
+{
+  OPTIMIZED_PROGRAM* optimized = new OPTIMIZED_PROGRAM;
+
+  optimized->graph = graph_create();
+
+  FACTS facts;
+  NAMES defined;
+
+  if (!optimize_body(optimized, program, NULL, facts, defined)) {
+    optimize_destroy(optimized);
+    return NULL;
+  }
+
+  for (vector<STMT*>& body : optimized->bodies)
+    find_dead_stores(optimized, body);
+
+  link_copies(optimized);
+
+  optimized->graph->program = survivor(optimized, program);
+
+  return optimized;
+}
+
+//
+// optimize_destroy
+//
+void optimize_destroy(struct OPTIMIZED_PROGRAM* optimized)
+{
+  if (optimized == NULL)
+    return;
+
+  graph_destroy(optimized->graph);
+  delete optimized;
+}
+
+//
+// optimize_entry
+//
+struct STMT* optimize_entry(struct OPTIMIZED_PROGRAM* optimized, struct STMT* stmt)
+{
+  return survivor(optimized, stmt);
+}
+
+//
+// optimize_original
+//
+struct STMT* optimize_original(struct OPTIMIZED_PROGRAM* optimized, struct STMT* stmt)
+{
+  if (stmt == NULL)
+    return NULL;
+
+  return optimized->originals[stmt];
+}
@@ -0,0 +1,77 @@
+/*optimize.h*/
+
+//
+// Optimizer for nuPython program graphs. From the program graph it
+// builds a second, optimized graph of the same program:
+//
+//   - constant folding: an expression whose operands are literals
+//     (x = 2 * 60) is replaced by its value (x = 120);
+//   - copy propagation: after x = 120 or b = x, later reads of x or
+//     b see the literal or x instead, until either is assigned again
+//     (which, with folding, turns d = x + 1 into d = 121);
+//   - dead store elimination: a store of a literal to a variable
+//     that already exists is dropped if a later store overwrites it
+//     before anything reads it, and nothing in between can fail.
+//
+// Every statement of the optimized graph has the line number of the
+// statement it was made from. Running it from the start leaves the
+// same output and the same memory as running the original program,
+// but in between memory may differ (a dropped store is never made),
+// so the debugger only runs it when nothing can stop the run before
+// the end: no breakpoints, no watches, and no journal. Single-
+// stepping always executes the original graph.
+//
+// Programs with pointers (any variable could change through one) or
+// if statements are not optimized.
+//
+
+#pragma once
+
+#include "programgraph.h"
+
+
+struct OPTIMIZED_PROGRAM;  // opaque, see optimize.cpp
+
+
+//
+// Public functions:
+//
+
+//
+// optimize_program
+//
+// Builds and returns the optimized form of the given program, or
+// NULL if the program can't be optimized. Call optimize_destroy() to
+// free it.
+//
+// NOTE: the optimized graph shares the nodes that didn't change
+// with the given graph, so that graph must outlive it.
+//
+struct OPTIMIZED_PROGRAM* optimize_program(struct STMT* program);
+
+//
+// optimize_destroy
+//
+// Frees the optimized graph.
+//
+void optimize_destroy(struct OPTIMIZED_PROGRAM* optimized);
+
+//
+// optimize_entry
+//
+// Given a statement of the original program, returns the statement
+// of the optimized program to continue from, to have the same effect
+// as continuing from stmt: its copy, or if stmt was dropped the copy
+// of the first statement after it that wasn't. Passing the first
+// statement of the program gives the first of the optimized one.
+// Returns NULL for NULL.
+//
+struct STMT* optimize_entry(struct OPTIMIZED_PROGRAM* optimized, struct STMT* stmt);
+
+//
+// optimize_original
+//
+// Given a statement of the optimized program, returns the statement
+// of the original program it was made from. Returns NULL for NULL.
+//
+struct STMT* optimize_original(struct OPTIMIZED_PROGRAM* optimized, struct STMT* stmt);
@@ -0,0 +1,455 @@
+/*parsecheck.cpp*/
+
+//
+// Differential check of the in-memory front end (lexer.cpp and
+// syntax.cpp) against the prebuilt one it replaces (scanner_nextToken()
+// and parser_parse() reading a FILE*). Each input is run through both,
+// and these must be the same:
+//
+//   - the tokens: id, line, column and value, up to the end of input;
+//   - the warnings the scanners output;
+//   - what parsing outputs (syntax errors), and whether it succeeds;
+//   - for a program that parses, its graph as programgraph_print()
+//     prints it: programgraph_build() on the parser's tokens against
+//     the graph syntax_parse() built. Programs the graph can't
+//     represent yet (if statements) are only checked up to parsing.
+//
+// The inputs are the files given, or else generated from a seed: text
+// made of nuPython words and near misses (keywords with a letter
+// changed, unterminated strings, numbers with two dots, characters
+// that aren't nuPython), and programs generated from the grammar, some
+// of them mutated into syntax errors:
+//
+//     make parsecheck
+//     ./parsecheck [count [seed]]
+//     ./parsecheck test.py test2.py ...
+//
+// Each input that differs is output, with what differs, and the exit
+// status is 1 if any did.
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <functional>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <unistd.h>
+
+#include "scanner.h"
+#include "parser.h"
+#include "programgraph.h"
+#include "lexer.h"
+#include "syntax.h"
+#include "graph.h"
+#include "source.h"
+
+using namespace std;
+
+
+#define MAX_DIFFERENCES 10  // inputs output before giving up
+
+//
+// runs f with stdout going to a temporary file, and returns what
+// it output:
+//
+static string captured(function<void()> f)
+{
+  fflush(stdout);
+
+  FILE* tmp = tmpfile();
+  int saved = dup(1);
+  dup2(fileno(tmp), 1);
+
+  f();
+
+  fflush(stdout);
+  dup2(saved, 1);
+  close(saved);
+
+  string output;
+  char buffer[4096];
+  size_t n;
+
+  rewind(tmp);
+  while ((n = fread(buffer, 1, sizeof(buffer), tmp)) > 0)
+    output.append(buffer, n);
+  fclose(tmp);
+
+  return output;
+}
+
+//
+// the text as a FILE*, the way the prebuilt front end reads it
+// (fmemopen() won't open an empty buffer):
+//
+static FILE* open_text(const string& text)
+{
+  if (text.empty())
+    return fopen("/dev/null", "r");
+
+  return fmemopen((void*) text.data(), text.size(), "r");
+}
+
+
+//
+// the tokens of text as "id line col value" lines, with either
+// scanner:
+//
+static string scan_prebuilt(const string& text)
+{
+  FILE* input = open_text(text);
+  string tokens;
+
+  static char value[1 << 16];
+  int line, col;
+
+  scanner_init(&line, &col, value);
+
+  while (true) {
+    struct Token token = scanner_nextToken(input, &line, &col, value);
+
+    tokens += to_string(token.id) + " " + to_string(token.line) + " " + to_string(token.col) + " " + value + "\n";
+    if (token.id == nuPy_EOS)
+      break;
+  }
+
+  fclose(input);
+  return tokens;
+}
+
+static string scan_lexer(const string& text)
+{
+  struct LEXER lexer;
+  string tokens;
+
+  lexer_init(&lexer, text.data(), text.size());
+
+  while (true) {
+    const char* value;
+    size_t length;
+
+    struct Token token = lexer_nextToken(&lexer, &value, &length);
+
+    tokens += to_string(token.id) + " " + to_string(token.line) + " " + to_string(token.col) + " " + string(value, length) + "\n";
+    if (token.id == nuPy_EOS)
+      break;
+  }
+
+  return tokens;
+}
+
+
+//
+// compares the two front ends on text; returns what differs, "" if
+// nothing does:
+//
+static string check(const string& text)
+{
+  string old_tokens, new_tokens;
+
+  string old_warnings = captured([&]() { old_tokens = scan_prebuilt(text); });
+  string new_warnings = captured([&]() { new_tokens = scan_lexer(text); });
+
+  if (old_tokens != new_tokens)
+    return "tokens";
+  if (old_warnings != new_warnings)
+    return "scanner warnings";
+
+  struct TokenQueue*    tokens = NULL;
+  struct PROGRAM_GRAPH* graph = NULL;
+
+  string old_output = captured([&]() {
+    FILE* input = open_text(text);
+    tokens = parser_parse(input);
+    fclose(input);
+  });
+  string new_output = captured([&]() { graph = syntax_parse(text.data(), text.size()); });
+
+  string differs;
+
+  if (old_output != new_output)
+    differs = "parser output";
+  else if ((tokens == NULL) != (graph == NULL))
+    differs = "parser result";
+  else if (graph != NULL && graph->unsupported == NULL) {
+    //
+    // programgraph_build() exits on what the graph can't represent,
+    // hence the check above:
+    //
+    string old_graph = captured([&]() {
+      struct STMT* program = programgraph_build(tokens);
+      programgraph_print(program);
+      programgraph_destroy(program);
+    });
+    string new_graph = captured([&]() { programgraph_print(graph->program); });
+
+    if (old_graph != new_graph)
+      differs = "program graph";
+  }
+
+  if (tokens != NULL)
+    tokenqueue_destroy(tokens);
+  if (graph != NULL)
+    graph_destroy(graph);
+
+  return differs;
+}
+
+
+//
+// input generators:
+//
+static mt19937 rng;
+
+static int pick(int n)
+{
+  return (int) (rng() % (unsigned) n);
+}
+
+static bool chance(int percent)
+{
+  return pick(100) < percent;
+}
+
+template <size_t N>
+static string one_of(const char* const (&choices)[N])
+{
+  return choices[pick((int) N)];
+}
+
+static const char* const keywords[] = {
+  "and", "break", "continue", "def", "elif", "else", "False", "for", "if",
+  "in", "is", "None", "not", "or", "pass", "return", "True", "while"
+};
+
+//
+// a keyword with one letter changed, dropped or doubled, or with
+// something after it:
+//
+static string near_miss()
+{
+  string word = one_of(keywords);
+  size_t at = pick((int) word.size());
+
+  switch (pick(5))
+  {
+  case 0:  word[at] = (char) ('a' + pick(26)); break;
+  case 1:  word.erase(at, 1); break;
+  case 2:  word.insert(at, 1, word[at]); break;
+  case 3:  word[at] = (char) (word[at] ^ 0x20); break;  // other case
+  default: word += one_of({ "_", "1", "s", "x" }); break;
+  }
+
+  return word;
+}
+
+//
+// text made of nuPython words, near misses and things that aren't
+// nuPython at all:
+//
+static string generate_text()
+{
+  static const char* const words[] = {
+    "x", "y2", "_z", "print", "input", "int", "float",
+    "0", "12", "007", "3.5", ".5", "89.", "1.2.3", "1..", ".",
+    "'abc'", "\"x y\"", "''", "'unterminated", "\"also", "'mixed\"",
+    "(", ")", "[", "]", "{", "}", "+", "-", "*", "**", "***", "%", "/",
+    "=", "==", "===", "!", "!=", "<", "<=", ">", ">=", "&", ":",
+    "@", "?", "`", "\t", "\r", "\\", "# a comment", "#", "$"
+  };
+  static const char* const separators[] = { " ", "", "", "\n", "  ", "\n\n" };
+
+  string text;
+  int count = 1 + pick(200);
+
+  for (int i = 0; i < count; i++) {
+    int kind = pick(10);
+
+    if (kind < 2)
+      text += one_of(keywords);
+    else if (kind < 4)
+      text += near_miss();
+    else
+      text += one_of(words);
+
+    text += one_of(separators);
+  }
+
+  return text;
+}
+
+static string expression();
+
+static string element()
+{
+  return one_of({ "x", "y", "z1", "123", "3.5", ".5", "'s'", "\"t\"", "True", "False", "None" });
+}
+
+static string unary()
+{
+  switch (pick(10))
+  {
+  case 0:  return string("*") + one_of({ "p", "1" });
+  case 1:  return string("&") + one_of({ "x", "2" });
+  case 2:  return one_of({ "+", "-" }) + one_of({ "x", "1", "2.5", "'a'" });
+  default: return element();
+  }
+}
+
+static string expression()
+{
+  static const char* const operators[] = {
+    "+", "-", "*", "**", "%", "/", "==", "!=", "<", "<=", ">", ">=", "in", "is", "and"
+  };
+
+  string expr = unary();
+
+  if (chance(50))
+    expr += string(" ") + one_of(operators) + " " + unary();
+
+  return expr;
+}
+
+static void body(vector<string>& lines, int depth);
+
+static void block(vector<string>& lines, const string& header, int depth)
+{
+  string indent(2 * depth, ' ');
+
+  lines.push_back(indent + header);
+  lines.push_back(indent + "{");
+  body(lines, depth + 1);
+  lines.push_back(indent + "}");
+}
+
+static void statement(vector<string>& lines, int depth)
+{
+  string indent(2 * depth, ' ');
+  int kind = pick(100);
+
+  if (kind < 35) {
+    string rhs = chance(20) ? one_of({ "input('a')", "int(x)", "float(y)", "print()" }) : expression();
+    lines.push_back(indent + one_of({ "", "*" }) + one_of({ "x", "y", "p" }) + " = " + rhs);
+  }
+  else if (kind < 50)
+    lines.push_back(indent + one_of({ "print", "input", "f" }) + "(" + (chance(70) ? element() : "") + ")");
+  else if (kind < 65 && depth < 4)
+    block(lines, "while " + expression() + ":", depth);
+  else if (kind < 72 && depth < 4) {
+    block(lines, "if " + expression() + ":", depth);
+    while (chance(30))
+      block(lines, "elif " + expression() + ":", depth);
+    if (chance(40))
+      block(lines, "else:", depth);
+  }
+  else if (kind < 82)
+    lines.push_back(indent + "pass");
+  else if (kind < 87)
+    lines.push_back(indent + "# comment $ 'x");
+  else
+    lines.push_back("");
+}
+
+static void body(vector<string>& lines, int depth)
+{
+  int count = 1 + pick(4);
+
+  for (int i = 0; i < count; i++)
+    statement(lines, depth);
+}
+
+//
+// a program from the grammar; most of the time a few characters are
+// then deleted or inserted, which mostly makes it a syntax error:
+//
+static string generate_program()
+{
+  vector<string> lines;
+  body(lines, 0);
+
+  string text;
+  for (const string& line : lines)
+    text += line + "\n";
+
+  if (chance(60)) {
+    int count = 1 + pick(3);
+
+    for (int i = 0; i < count; i++) {
+      size_t at = pick((int) text.size() + 1);
+      int    kind = pick(10);
+
+      if (kind < 4 && at < text.size())
+        text.erase(at, 1);
+      else if (kind < 8)
+        text.insert(at, one_of({ "(", ")", "{", "}", ":", "=", "*", "\n", "$", "#", "'", "\"", "+",
+                                 "x", "1", ".", "!", "<", "[", "]", " ", "if", "else", "elif", "while" }));
+      else {
+        size_t eoln = text.find('\n', at);
+        if (eoln != string::npos)
+          text.erase(eoln, 1);
+      }
+    }
+  }
+
+  return text;
+}
+
+
+//
+// checks one input, outputting it if it differs; returns true if it
+// doesn't:
+//
+static bool report(const string& name, const string& text)
+{
+  string differs = check(text);
+
+  if (differs.empty())
+    return true;
+
+  cout << "**DIFFERENT " << differs << ": " << name << endl;
+  cout << "----" << endl << text << (text.empty() || text.back() != '\n' ? "\n" : "") << "----" << endl;
+  return false;
+}
+
+int main(int argc, char* argv[])
+{
+  int checked = 0, different = 0;
+
+  if (argc > 1 && !isdigit((unsigned char) argv[1][0])) {
+    for (int i = 1; i < argc && different < MAX_DIFFERENCES; i++) {
+      struct SOURCE* source = source_open(argv[i]);
+
+      if (source == nullptr) {
+        cout << "**ERROR: unable to open input file '" << argv[i] << "'." << endl;
+        return 1;
+      }
+
+      checked++;
+      if (!report(argv[i], string(source->text, source->length)))
+        different++;
+
+      source_destroy(source);
+    }
+  }
+  else {
+    int count = (argc > 1) ? atoi(argv[1]) : 1000;
+    unsigned seed = (argc > 2) ? (unsigned) atoi(argv[2]) : 1;
+
+    for (int i = 0; i < count && different < MAX_DIFFERENCES; i++) {
+      rng.seed(seed + i);  // so input i can be made again on its own
+
+      string text = (i % 2 == 0) ? generate_text() : generate_program();
+
+      checked++;
+      if (!report("input " + to_string(i) + " of seed " + to_string(seed), text))
+        different++;
+    }
+  }
+
+  cout << checked << " inputs checked, " << different << " different" << endl;
+  return (different == 0) ? 0 : 1;
+}
@@ -11,6 +11,8 @@
 #pragma once
 
 #include <stdbool.h>  // true, false
+#include <stddef.h>   // NULL
+#include <stdlib.h>   // free
 
 
 //
@@ -125,6 +127,28 @@ struct RAM_VALUE* ram_read_cell_by_addr(struct RAM* memory, int address);
 //
 struct RAM_VALUE* ram_read_cell_by_name(struct RAM* memory, char* name);
 
+//
+// ram_peek_by_addr
+//
+// Given a memory address (an integer in the range 0..N-1),
+// returns a read-only pointer to the value contained in that
+// memory cell. Returns NULL if the address is not valid.
+//
+// NOTE: unlike ram_read_cell_by_addr, no copy is made and 
+// nothing is allocated. The value is borrowed from memory and
+// must NOT be passed to ram_free_value(). The pointer (and any
+// string it refers to) is only valid until the next write to
+// memory, since a write may overwrite the value or grow the
+// array of cells.
+//
+static inline const struct RAM_VALUE* ram_peek_by_addr(struct RAM* memory, int address)
+{
+  if (address < 0 || address >= memory->num_values)
+    return NULL;
+
+  return &memory->cells[address].value;
+}
+
 //
 // ram_free_value
 //
@@ -168,6 +192,32 @@ bool ram_write_cell_by_addr(struct RAM* memory, struct RAM_VALUE value, int addr
 //
 bool ram_write_cell_by_name(struct RAM* memory, struct RAM_VALUE value, char* name);
 
+//
+// ram_pop_cell
+//
+// Removes the most recently created memory cell (the one with
+// the highest address), freeing its name and value. Used to
+// undo the write that created a variable.
+//
+// NOTE: this is the only way a valid address becomes invalid,
+// so anyone caching addresses must forget this one.
+//
+static inline void ram_pop_cell(struct RAM* memory)
+{
+  if (memory->num_values == 0)
+    return;
+
+  struct RAM_CELL* cell = &memory->cells[memory->num_values - 1];
+
+  if (cell->value.value_type == RAM_TYPE_STR)
+    free(cell->value.types.s);
+  free(cell->identifier);
+
+  cell->identifier = NULL;
+  cell->value.value_type = RAM_TYPE_NONE;
+  memory->num_values--;
+}
+
 //
 // ram_print
 //
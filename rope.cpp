@@ -0,0 +1,194 @@
+/*rope.cpp*/
+
+//
+// Immutable, reference-counted strings. See rope.h.
+//
+// A string built by appending (s = s + "x") is a left-leaning chain
+// of concatenations as deep as the number of appends, so nothing
+// here recurses: flattening and freeing walk the chain with an
+// explicit stack. Appending short pieces copies them into the
+// rightmost flat piece (while that stays short), which keeps the
+// chain ROPE_PIECE_SIZE times shorter than the number of appends.
+//
+
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+
+#include "rope.h"
+
+using namespace std;
+
+
+#define ROPE_PIECE_SIZE 128  // flat pieces up to this long are copied rather than shared
+
+
+//
+// helpers:
+//
+
+//
+// returns a new flat string of the n1 characters at s1 followed by
+// the n2 at s2:
+//
+static ROPE* rope_flat(const char* s1, size_t n1, const char* s2, size_t n2)
+{
+  ROPE* rope = (ROPE*) malloc(sizeof(ROPE) + n1 + n2 + 1);
+
+  rope->refs = 1;
+  rope->length = n1 + n2;
+  rope->left = NULL;
+  rope->right = NULL;
+  rope->chars = (char*) (rope + 1);
+
+  memcpy(rope->chars, s1, n1);
+  memcpy(rope->chars + n1, s2, n2);
+  rope->chars[n1 + n2] = '\0';
+
+  return rope;
+}
+
+//
+// returns a new concatenation, taking over the callers' references
+// to left and right:
+//
+static ROPE* rope_node(ROPE* left, ROPE* right)
+{
+  ROPE* rope = (ROPE*) malloc(sizeof(ROPE));
+
+  rope->refs = 1;
+  rope->length = left->length + right->length;
+  rope->left = left;
+  rope->right = right;
+  rope->chars = NULL;
+
+  return rope;
+}
+
+static bool is_flat(ROPE* rope)
+{
+  return rope->chars == (char*) (rope + 1);
+}
+
+
+//
+// public functions:
+//
+struct ROPE* rope_create(const char* s, size_t length)
+{
+  return rope_flat(s, length, "", 0);
+}
+
+struct ROPE* rope_append(struct ROPE* left, const char* s, size_t length)
+{
+  if (length == 0) {
+    rope_ref(left);
+    return left;
+  }
+
+  if (left->length + length <= ROPE_PIECE_SIZE)
+    return rope_flat(rope_chars(left), left->length, s, length);
+
+  //
+  // (a + b) + s => a + (b + s) while b + s is short; a is shared,
+  // so left itself is unchanged:
+  //
+  ROPE* last = left->right;
+
+  if (left->left != NULL && is_flat(last) && last->length + length <= ROPE_PIECE_SIZE) {
+    rope_ref(left->left);
+    return rope_node(left->left, rope_flat(last->chars, last->length, s, length));
+  }
+
+  rope_ref(left);
+  return rope_node(left, rope_flat(s, length, "", 0));
+}
+
+struct ROPE* rope_concat(struct ROPE* left, struct ROPE* right)
+{
+  if (right->length <= ROPE_PIECE_SIZE)
+    return rope_append(left, rope_chars(right), right->length);
+
+  if (left->length == 0) {
+    rope_ref(right);
+    return right;
+  }
+
+  rope_ref(left);
+  rope_ref(right);
+  return rope_node(left, right);
+}
+
+const char* rope_flatten(struct ROPE* rope)
+{
+  char*  chars = (char*) malloc(rope->length + 1);
+  size_t used = 0;
+
+  //
+  // copy the flat pieces left to right; a piece that was already
+  // flattened is copied whole rather than walked again:
+  //
+  vector<ROPE*> pending;
+  pending.push_back(rope);
+
+  while (!pending.empty()) {
+    ROPE* piece = pending.back();
+    pending.pop_back();
+
+    if (piece->chars != NULL) {
+      memcpy(chars + used, piece->chars, piece->length);
+      used += piece->length;
+    }
+    else {
+      pending.push_back(piece->right);
+      pending.push_back(piece->left);
+    }
+  }
+
+  chars[used] = '\0';
+
+  //
+  // the halves aren't needed anymore:
+  //
+  ROPE* left = rope->left;
+  ROPE* right = rope->right;
+
+  rope->chars = chars;
+  rope->left = NULL;
+  rope->right = NULL;
+
+  rope_unref(left);
+  rope_unref(right);
+
+  return chars;
+}
+
+void rope_free(struct ROPE* rope)
+{
+  if (rope->left == NULL) {  // flat or flattened, the common case
+    if (!is_flat(rope))
+      free(rope->chars);
+    free(rope);
+    return;
+  }
+
+  vector<ROPE*> dead;
+  dead.push_back(rope);
+
+  while (!dead.empty()) {
+    ROPE* piece = dead.back();
+    dead.pop_back();
+
+    if (piece->left != NULL) {
+      if (--piece->left->refs == 0)
+        dead.push_back(piece->left);
+      if (--piece->right->refs == 0)
+        dead.push_back(piece->right);
+    }
+
+    if (piece->chars != NULL && !is_flat(piece))
+      free(piece->chars);
+
+    free(piece);
+  }
+}
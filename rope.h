@@ -0,0 +1,115 @@
+/*rope.h*/
+
+//
+// Immutable, reference-counted strings for the VM. A string is
+// either flat -- its characters stored inline, right after the
+// header, in a single allocation -- or a concatenation of two other
+// strings. Concatenating is O(1): it makes a node referring to both
+// halves rather than copying them, so building a string piece by
+// piece (s = s + "x") is linear rather than quadratic. The characters
+// of a concatenation are only gathered when they are needed (to
+// compare, print or store the string), and then kept, so a string is
+// flattened at most once.
+//
+// Strings are never modified once built, so any number of values
+// may share one; each holder owns a reference, and the string is
+// freed when the last reference is dropped.
+//
+
+#pragma once
+
+#include <stddef.h>
+
+
+struct ROPE
+{
+  int    refs;           // number of holders
+  size_t length;         // number of characters
+
+  struct ROPE* left;     // a concatenation left + right, until flattened
+  struct ROPE* right;
+
+  char*  chars;          // NUL-terminated characters, NULL until flattened
+};
+
+
+//
+// Public functions:
+//
+
+//
+// rope_create
+//
+// Returns a new flat string holding a copy of the length characters
+// at s, with one reference.
+//
+struct ROPE* rope_create(const char* s, size_t length);
+
+//
+// rope_concat
+//
+// Returns left + right, with one reference; left and right are not
+// consumed (the result takes references of its own). Short right
+// halves are copied into a flat piece, so a string built a character
+// at a time doesn't become a node per character.
+//
+struct ROPE* rope_concat(struct ROPE* left, struct ROPE* right);
+
+//
+// rope_append
+//
+// Returns left + the length characters at s, with one reference.
+// Same as rope_concat(), without making a string of s first.
+//
+struct ROPE* rope_append(struct ROPE* left, const char* s, size_t length);
+
+//
+// rope_flatten
+//
+// Gathers the characters of a concatenation. Use rope_chars().
+//
+const char* rope_flatten(struct ROPE* rope);
+
+//
+// rope_free
+//
+// Frees a string that has no references left. Use rope_unref().
+//
+void rope_free(struct ROPE* rope);
+
+
+//
+// rope_ref
+//
+// Takes another reference to the string.
+//
+static inline void rope_ref(struct ROPE* rope)
+{
+  rope->refs++;
+}
+
+//
+// rope_unref
+//
+// Drops a reference to the string, freeing it if it was the last.
+//
+static inline void rope_unref(struct ROPE* rope)
+{
+  if (--rope->refs == 0)
+    rope_free(rope);
+}
+
+//
+// rope_chars
+//
+// Returns the string's characters, NUL-terminated, flattening it
+// first if it's a concatenation. The characters are valid as long as
+// the caller holds a reference.
+//
+static inline const char* rope_chars(struct ROPE* rope)
+{
+  if (rope->chars != NULL)
+    return rope->chars;
+
+  return rope_flatten(rope);
+}
@@ -0,0 +1,145 @@
+/*scanbench.cpp*/
+
+//
+// Scanner throughput benchmark: scans a nuPython program with the
+// prebuilt scanner (scanner_nextToken() reading a FILE*) and with the
+// lexer (reading the program from memory), and reports tokens per
+// second for each. The program is scanned several times over and the
+// best time is reported, so the numbers are stable enough to compare:
+//
+//     make scanbench file=big.py
+//     ./scanbench big.py [repeat]
+//
+// The program isn't run, or even parsed, so any text will do; large
+// machine-generated programs show the difference best.
+//
+
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "scanner.h"
+#include "lexer.h"
+#include "source.h"
+
+using namespace std;
+
+
+//
+// scans the whole program once with each scanner, returning the
+// number of tokens (EOS included):
+//
+static long scan_file(const struct SOURCE* source)
+{
+  FILE* input = fmemopen((void*) source->text, source->length, "r");
+  if (input == nullptr)
+    return 0;
+
+  static char value[1 << 16];
+  int line, col;
+  long count = 0;
+
+  scanner_init(&line, &col, value);
+
+  while (true) {
+    struct Token token = scanner_nextToken(input, &line, &col, value);
+    count++;
+
+    if (token.id == nuPy_EOS)
+      break;
+  }
+
+  fclose(input);
+  return count;
+}
+
+static long scan_lexer(const struct SOURCE* source)
+{
+  struct LEXER lexer;
+  lexer_init(&lexer, source->text, source->length);
+
+  long count = 0;
+
+  while (true) {
+    const char* value;
+    size_t length;
+
+    struct Token token = lexer_nextToken(&lexer, &value, &length);
+    count++;
+
+    if (token.id == nuPy_EOS)
+      break;
+  }
+
+  return count;
+}
+
+
+//
+// best of repeat runs, in seconds:
+//
+static double best_time(long (*scan)(const struct SOURCE*), const struct SOURCE* source, int repeat, long* tokens)
+{
+  double best = 0;
+
+  for (int i = 0; i < repeat; i++) {
+    auto start = chrono::steady_clock::now();
+    *tokens = scan(source);
+    auto stop = chrono::steady_clock::now();
+
+    double seconds = chrono::duration<double>(stop - start).count();
+    if (i == 0 || seconds < best)
+      best = seconds;
+  }
+
+  return best;
+}
+
+static void report(const char* name, long tokens, double seconds, size_t length)
+{
+  printf("%-28s %10ld tokens  %8.3f s  %8.2f M tokens/s  %8.1f MB/s\n",
+    name, tokens, seconds, tokens / seconds / 1e6, length / seconds / 1e6);
+}
+
+
+//
+// main
+//
+// usage: ./scanbench filename.py [repeat]
+//
+int main(int argc, char* argv[])
+{
+  if (argc < 2) {
+    cout << "usage: ./scanbench filename.py [repeat]" << endl;
+    return 0;
+  }
+
+  int repeat = (argc > 2) ? atoi(argv[2]) : 5;
+  if (repeat < 1)
+    repeat = 1;
+
+  struct SOURCE* source = source_open(argv[1]);
+
+  if (source == nullptr) {
+    cout << "**ERROR: unable to open input file '"
+         << argv[1]
+         << "' for input." << endl;
+
+    return 0;
+  }
+
+  printf("%s: %zu bytes, best of %d\n", argv[1], source->length, repeat);
+
+  long tokens;
+  double seconds;
+
+  seconds = best_time(scan_file, source, repeat, &tokens);
+  report("scanner_nextToken (FILE*)", tokens, seconds, source->length);
+
+  seconds = best_time(scan_lexer, source, repeat, &tokens);
+  report("lexer_nextToken (memory)", tokens, seconds, source->length);
+
+  source_destroy(source);
+  return 0;
+}
@@ -0,0 +1,169 @@
+/*sink.cpp*/
+
+//
+// Output sinks for nuPython program output. See sink.h.
+//
+// Every sink is a stdio stream with a large buffer, so stdio does
+// the buffering and formatting for all three kinds:
+//
+//   SINK_FILE:    the file itself
+//   SINK_STDOUT:  a custom stream (fopencookie) whose writes are
+//                 passed on to the real stdout
+//   SINK_MEMORY:  a custom stream whose writes are appended to a
+//                 buffer
+//
+// On a terminal, the stdout sink is line buffered and writes
+// straight through, so the output and input() prompts of a
+// running program show up as they are printed.
+//
+
+#include <vector>
+#include <cstdio>
+#include <cstring>
+
+#include <unistd.h>
+
+#include "sink.h"
+
+using namespace std;
+
+
+#define SINK_BUFFER_SIZE (64 * 1024)
+
+struct OUTPUT_SINK
+{
+  int   kind;         // enum OUTPUT_SINK_KINDS
+  FILE* stream;       // where program output is written
+  FILE* console;      // the real stdout
+  FILE* saved;        // stdout before sink_begin()
+  bool  interactive;  // console is a terminal
+
+  vector<char> contents;  // SINK_MEMORY: output collected so far
+};
+
+
+//
+// write functions of the custom streams:
+//
+static ssize_t sink_write_console(void* cookie, const char* buffer, size_t size)
+{
+  OUTPUT_SINK* sink = (OUTPUT_SINK*) cookie;
+
+  size_t written = fwrite(buffer, 1, size, sink->console);
+
+  if (sink->interactive)
+    fflush(sink->console);
+
+  return written;
+}
+
+static ssize_t sink_write_memory(void* cookie, const char* buffer, size_t size)
+{
+  OUTPUT_SINK* sink = (OUTPUT_SINK*) cookie;
+
+  sink->contents.insert(sink->contents.end(), buffer, buffer + size);
+  return size;
+}
+
+
+//
+// sink_create
+//
+struct OUTPUT_SINK* sink_create(int kind, const char* filename)
+{
+  OUTPUT_SINK* sink = new OUTPUT_SINK;
+  sink->kind = kind;
+  sink->console = stdout;
+  sink->saved = NULL;
+  sink->interactive = isatty(fileno(stdout));
+
+  cookie_io_functions_t functions;
+  memset(&functions, 0, sizeof(functions));
+
+  if (kind == SINK_FILE) {
+    sink->stream = fopen(filename, "w");
+  }
+  else if (kind == SINK_MEMORY) {
+    functions.write = sink_write_memory;
+    sink->stream = fopencookie(sink, "w", functions);
+  }
+  else {
+    functions.write = sink_write_console;
+    sink->stream = fopencookie(sink, "w", functions);
+  }
+
+  if (sink->stream == NULL) {
+    delete sink;
+    return NULL;
+  }
+
+  if (kind == SINK_STDOUT && sink->interactive)
+    setvbuf(sink->stream, NULL, _IOLBF, SINK_BUFFER_SIZE);
+  else
+    setvbuf(sink->stream, NULL, _IOFBF, SINK_BUFFER_SIZE);
+
+  return sink;
+}
+
+
+//
+// sink_destroy
+//
+void sink_destroy(struct OUTPUT_SINK* sink)
+{
+  if (sink->saved != NULL)
+    sink_end(sink);
+
+  fclose(sink->stream);
+  delete sink;
+}
+
+
+//
+// sink_begin
+//
+void sink_begin(struct OUTPUT_SINK* sink)
+{
+  sink->saved = stdout;
+  stdout = sink->stream;
+}
+
+
+//
+// sink_end
+//
+void sink_end(struct OUTPUT_SINK* sink)
+{
+  fflush(sink->stream);
+
+  stdout = sink->saved;
+  sink->saved = NULL;
+}
+
+
+//
+// sink_contents
+//
+const char* sink_contents(struct OUTPUT_SINK* sink, size_t* length)
+{
+  if (sink->kind != SINK_MEMORY)
+    return NULL;
+
+  fflush(sink->stream);
+
+  *length = sink->contents.size();
+  return sink->contents.data();
+}
+
+
+//
+// sink_clear
+//
+void sink_clear(struct OUTPUT_SINK* sink)
+{
+  if (sink->kind != SINK_MEMORY)
+    return;
+
+  fflush(sink->stream);
+  sink->contents.clear();
+}
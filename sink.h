@@ -0,0 +1,84 @@
+/*sink.h*/
+
+//
+// Output sinks for the output of a nuPython program (print() and
+// input() prompts, and the error messages of execution), kept apart
+// from the debugger's own output. A sink sends program output to the
+// console, collects it in memory, or writes it to a file, and
+// buffers it in between flush points: the debugger flushes the sink
+// whenever execution stops (a step ends, a breakpoint is hit, the
+// program completes), so program output still appears in order with
+// the debugger's output without being written a line at a time.
+//
+// Both engines write program output to stdout. Between sink_begin()
+// and sink_end(), stdout is the sink's stream, so the output of the
+// prebuilt execute() goes through the sink the same way as the VM's.
+//
+
+#pragma once
+
+#include <stdio.h>
+#include <stddef.h>
+
+
+struct OUTPUT_SINK;  // opaque, see sink.cpp
+
+enum OUTPUT_SINK_KINDS
+{
+  SINK_STDOUT = 0,  // the console (the real stdout), in order with the debugger's output
+  SINK_MEMORY,      // a buffer in memory, see sink_contents()
+  SINK_FILE         // a file
+};
+
+
+//
+// Public functions:
+//
+
+//
+// sink_create
+//
+// Returns a new sink of the given kind; filename is the file to
+// (over)write for SINK_FILE, and is otherwise ignored. Returns NULL
+// if the file can't be opened. Call sink_destroy() to free it.
+//
+struct OUTPUT_SINK* sink_create(int kind, const char* filename);
+
+//
+// sink_destroy
+//
+// Flushes the sink and frees it (closing its file, if any).
+//
+void sink_destroy(struct OUTPUT_SINK* sink);
+
+//
+// sink_begin
+//
+// Program output from now on goes to the sink: stdout is the sink's
+// stream until sink_end() is called.
+//
+void sink_begin(struct OUTPUT_SINK* sink);
+
+//
+// sink_end
+//
+// A flush point: restores stdout, and writes the program output
+// buffered so far to the sink's destination.
+//
+void sink_end(struct OUTPUT_SINK* sink);
+
+//
+// sink_contents
+//
+// For a SINK_MEMORY sink, returns the output collected so far and
+// sets *length to its length (the output is not NUL terminated).
+// Returns NULL for the other kinds of sink.
+//
+const char* sink_contents(struct OUTPUT_SINK* sink, size_t* length);
+
+//
+// sink_clear
+//
+// For a SINK_MEMORY sink, forgets the output collected so far.
+//
+void sink_clear(struct OUTPUT_SINK* sink);
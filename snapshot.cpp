@@ -0,0 +1,295 @@
+/*snapshot.cpp*/
+
+//
+// Binary snapshots of memory. See snapshot.h.
+//
+// Layout of a snapshot file:
+//
+//   header:   struct SNAPSHOT_HEADER (40 bytes)
+//   cells:    num_cells x struct SNAPSHOT_CELL (16 bytes each)
+//   strings:  num_strings offsets (4 bytes each), then string_bytes
+//             bytes of NUL-terminated strings
+//
+// A cell refers to its identifier, and to its value if that is a
+// string, by index into the string table.
+//
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "snapshot.h"
+
+using namespace std;
+
+
+#define SNAPSHOT_MAGIC   "NUPYSNAP"
+#define SNAPSHOT_VERSION 1
+
+struct SNAPSHOT_HEADER
+{
+  char     magic[8];
+  uint32_t version;
+  uint32_t program_id;
+  int32_t  line;
+  uint32_t flags;
+  uint32_t num_cells;
+  uint32_t num_strings;
+  uint32_t string_bytes;
+  uint32_t reserved;
+};
+
+struct SNAPSHOT_CELL
+{
+  uint32_t name;        // string index
+  int32_t  value_type;  // enum RAM_VALUE_TYPES
+  union
+  {
+    int32_t  i;  // INT, PTR, BOOLEAN
+    double   d;  // REAL
+    uint32_t s;  // STR: string index
+  } types;
+};
+
+
+//
+// strings of a snapshot being saved, each stored once:
+//
+struct SNAPSHOT_STRINGS
+{
+  unordered_map<string_view, uint32_t> index;
+  vector<uint32_t> offsets;
+  vector<char> bytes;
+};
+
+static uint32_t snapshot_intern(SNAPSHOT_STRINGS* strings, const char* s)
+{
+  auto found = strings->index.find(s);
+  if (found != strings->index.end())
+    return found->second;
+
+  uint32_t index = (uint32_t) strings->offsets.size();
+
+  strings->offsets.push_back((uint32_t) strings->bytes.size());
+  strings->bytes.insert(strings->bytes.end(), s, s + strlen(s) + 1);
+
+  //
+  // the key points into memory, which doesn't change while saving:
+  //
+  strings->index[s] = index;
+  return index;
+}
+
+
+//
+// snapshot_save
+//
+int snapshot_save(const char* filename, unsigned int program_id,
+                  struct RAM* memory, const struct SNAPSHOT_INFO* info)
+{
+  SNAPSHOT_STRINGS strings;
+  vector<SNAPSHOT_CELL> cells(memory->num_values);
+
+  for (int i = 0; i < memory->num_values; i++) {
+    struct RAM_CELL* cell = &memory->cells[i];
+
+    memset(&cells[i], 0, sizeof(SNAPSHOT_CELL));
+    cells[i].name = snapshot_intern(&strings, cell->identifier);
+    cells[i].value_type = cell->value.value_type;
+
+    if (cell->value.value_type == RAM_TYPE_REAL)
+      cells[i].types.d = cell->value.types.d;
+    else if (cell->value.value_type == RAM_TYPE_STR)
+      cells[i].types.s = snapshot_intern(&strings, cell->value.types.s);
+    else if (cell->value.value_type != RAM_TYPE_NONE)
+      cells[i].types.i = cell->value.types.i;
+  }
+
+  SNAPSHOT_HEADER header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+  header.version = SNAPSHOT_VERSION;
+  header.program_id = program_id;
+  header.line = info->line;
+  header.flags = info->flags;
+  header.num_cells = (uint32_t) cells.size();
+  header.num_strings = (uint32_t) strings.offsets.size();
+  header.string_bytes = (uint32_t) strings.bytes.size();
+
+  FILE* output = fopen(filename, "wb");
+  if (output == NULL)
+    return SNAPSHOT_IO_ERROR;
+
+  bool written =
+    fwrite(&header, sizeof(header), 1, output) == 1 &&
+    fwrite(cells.data(), sizeof(SNAPSHOT_CELL), cells.size(), output) == cells.size() &&
+    fwrite(strings.offsets.data(), sizeof(uint32_t), strings.offsets.size(), output) == strings.offsets.size() &&
+    fwrite(strings.bytes.data(), 1, strings.bytes.size(), output) == strings.bytes.size();
+
+  if (fclose(output) != 0 || !written)
+    return SNAPSHOT_IO_ERROR;
+
+  return SNAPSHOT_OK;
+}
+
+
+//
+// checks the header and tables of a mapped snapshot of the given
+// size, returning SNAPSHOT_OK if every cell can be loaded safely:
+//
+static int snapshot_check(const char* data, size_t size, unsigned int program_id)
+{
+  if (size < sizeof(SNAPSHOT_HEADER))
+    return SNAPSHOT_BAD_FILE;
+
+  const SNAPSHOT_HEADER* header = (const SNAPSHOT_HEADER*) data;
+
+  if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 || header->version != SNAPSHOT_VERSION)
+    return SNAPSHOT_BAD_FILE;
+
+  if (header->program_id != program_id)
+    return SNAPSHOT_WRONG_PROGRAM;
+
+  size_t expected = sizeof(SNAPSHOT_HEADER)
+    + (size_t) header->num_cells * sizeof(SNAPSHOT_CELL)
+    + (size_t) header->num_strings * sizeof(uint32_t)
+    + header->string_bytes;
+
+  if (size != expected || header->num_cells > (uint32_t) INT32_MAX)
+    return SNAPSHOT_BAD_FILE;
+
+  //
+  // every string must start inside the string bytes, which must end
+  // with a NUL, so strings can't run off the end:
+  //
+  const uint32_t* offsets = (const uint32_t*) (data + sizeof(SNAPSHOT_HEADER) + (size_t) header->num_cells * sizeof(SNAPSHOT_CELL));
+  const char* bytes = (const char*) (offsets + header->num_strings);
+
+  if (header->num_strings > 0 && (header->string_bytes == 0 || bytes[header->string_bytes - 1] != '\0'))
+    return SNAPSHOT_BAD_FILE;
+
+  for (uint32_t i = 0; i < header->num_strings; i++)
+    if (offsets[i] >= header->string_bytes)
+      return SNAPSHOT_BAD_FILE;
+
+  const SNAPSHOT_CELL* cells = (const SNAPSHOT_CELL*) (data + sizeof(SNAPSHOT_HEADER));
+
+  for (uint32_t i = 0; i < header->num_cells; i++) {
+    if (cells[i].name >= header->num_strings)
+      return SNAPSHOT_BAD_FILE;
+    if (cells[i].value_type < RAM_TYPE_INT || cells[i].value_type > RAM_TYPE_NONE)
+      return SNAPSHOT_BAD_FILE;
+    if (cells[i].value_type == RAM_TYPE_STR && cells[i].types.s >= header->num_strings)
+      return SNAPSHOT_BAD_FILE;
+  }
+
+  return SNAPSHOT_OK;
+}
+
+
+//
+// snapshot_load
+//
+int snapshot_load(const char* filename, unsigned int program_id,
+                  struct RAM* memory, struct SNAPSHOT_INFO* info)
+{
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+    return SNAPSHOT_IO_ERROR;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return SNAPSHOT_IO_ERROR;
+  }
+
+  if (st.st_size < (off_t) sizeof(SNAPSHOT_HEADER)) {  // can't map an empty file
+    close(fd);
+    return SNAPSHOT_BAD_FILE;
+  }
+
+  size_t size = (size_t) st.st_size;
+  void* mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (mapped == MAP_FAILED)
+    return SNAPSHOT_IO_ERROR;
+
+  const char* data = (const char*) mapped;
+  int status = snapshot_check(data, size, program_id);
+
+  if (status != SNAPSHOT_OK) {
+    munmap(mapped, size);
+    return status;
+  }
+
+  const SNAPSHOT_HEADER* header = (const SNAPSHOT_HEADER*) data;
+  const SNAPSHOT_CELL* cells = (const SNAPSHOT_CELL*) (data + sizeof(SNAPSHOT_HEADER));
+  const uint32_t* offsets = (const uint32_t*) (cells + header->num_cells);
+  const char* bytes = (const char*) (offsets + header->num_strings);
+
+  //
+  // make room for all the cells at once, before anything in memory
+  // changes so that memory is left as it was if there's no room:
+  //
+  int num_cells = (int) header->num_cells;
+
+  if (num_cells > memory->capacity) {
+    struct RAM_CELL* grown = (struct RAM_CELL*) realloc(memory->cells, num_cells * sizeof(struct RAM_CELL));
+
+    if (grown == NULL) {
+      munmap(mapped, size);
+      return SNAPSHOT_IO_ERROR;
+    }
+
+    memory->cells = grown;
+    memory->capacity = num_cells;
+  }
+
+  //
+  // then empty memory the way ram_destroy() does, and fill it in:
+  //
+  for (int i = 0; i < memory->num_values; i++) {
+    free(memory->cells[i].identifier);
+    if (memory->cells[i].value.value_type == RAM_TYPE_STR)
+      free(memory->cells[i].value.types.s);
+  }
+  memory->num_values = 0;
+
+  for (int i = 0; i < num_cells; i++) {
+    struct RAM_CELL* cell = &memory->cells[i];
+
+    cell->identifier = strdup(bytes + offsets[cells[i].name]);
+    cell->value.value_type = cells[i].value_type;
+
+    if (cells[i].value_type == RAM_TYPE_REAL)
+      cell->value.types.d = cells[i].types.d;
+    else if (cells[i].value_type == RAM_TYPE_STR)
+      cell->value.types.s = strdup(bytes + offsets[cells[i].types.s]);
+    else
+      cell->value.types.i = cells[i].types.i;
+  }
+
+  for (int i = num_cells; i < memory->capacity; i++) {
+    memory->cells[i].identifier = NULL;
+    memory->cells[i].value.value_type = RAM_TYPE_NONE;
+  }
+
+  memory->num_values = num_cells;
+
+  info->line = header->line;
+  info->flags = (int) header->flags;
+
+  munmap(mapped, size);
+  return SNAPSHOT_OK;
+}
@@ -0,0 +1,65 @@
+/*snapshot.h*/
+
+//
+// Snapshots of a nuPython debugging session: the contents of memory
+// and where execution is, saved to a compact binary file so a session
+// can be resumed later without re-executing the program.
+//
+// The file is a fixed header, a table of fixed-size cells, and a
+// table of interned strings (identifiers and string values, each
+// stored once no matter how many cells use it). Numbers are stored in
+// the machine's native byte order; a snapshot is meant to be loaded
+// on the machine that saved it. Loading maps the file into memory
+// and rebuilds the RAM in one pass over the cell table.
+//
+
+#pragma once
+
+#include "ram.h"
+
+
+enum SNAPSHOT_STATUS
+{
+  SNAPSHOT_OK = 0,
+  SNAPSHOT_IO_ERROR,       // file couldn't be opened, read or written (or no memory to load it)
+  SNAPSHOT_BAD_FILE,       // not a snapshot, or a damaged one
+  SNAPSHOT_WRONG_PROGRAM   // snapshot of a different program
+};
+
+enum SNAPSHOT_FLAGS
+{
+  SNAPSHOT_STARTED = 1,        // program had started running
+  SNAPSHOT_AT_BREAKPOINT = 2   // stopped at a breakpoint that was already announced
+};
+
+struct SNAPSHOT_INFO
+{
+  int line;   // line of the statement that executes next, -1 if the program completed
+  int flags;  // enum SNAPSHOT_FLAGS
+};
+
+
+//
+// Public functions:
+//
+
+//
+// snapshot_save
+//
+// Writes memory and the position in info to the given file,
+// tagged with program_id (any number identifying the program, so
+// the snapshot can't be loaded into a different one).
+//
+int snapshot_save(const char* filename, unsigned int program_id,
+                  struct RAM* memory, const struct SNAPSHOT_INFO* info);
+
+//
+// snapshot_load
+//
+// Reads a snapshot written by snapshot_save() for the same
+// program_id, replacing the contents of memory and filling in
+// *info. Addresses of the variables are the same as when the
+// snapshot was saved. On failure, memory is left as it was.
+//
+int snapshot_load(const char* filename, unsigned int program_id,
+                  struct RAM* memory, struct SNAPSHOT_INFO* info);
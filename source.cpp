@@ -0,0 +1,188 @@
+/*source.cpp*/
+
+//
+// The text of a nuPython program in one buffer. See source.h.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "source.h"
+
+using namespace std;
+
+
+//
+// a buffer that doubles in size as characters are appended:
+//
+struct SOURCE_BUFFER
+{
+  char*  text;
+  size_t length;
+  size_t capacity;
+};
+
+//
+// returns false if there's no memory for the characters, in which
+// case the buffer is freed:
+//
+static bool buffer_append(SOURCE_BUFFER* buffer, const char* text, size_t length)
+{
+  if (buffer->length + length > buffer->capacity) {
+    size_t capacity = (buffer->capacity == 0) ? 4096 : buffer->capacity;
+
+    while (buffer->length + length > capacity)
+      capacity *= 2;
+
+    char* grown = (char*) realloc(buffer->text, capacity);
+    if (grown == NULL) {
+      free(buffer->text);
+      buffer->text = NULL;
+      return false;
+    }
+
+    buffer->text = grown;
+    buffer->capacity = capacity;
+  }
+
+  memcpy(buffer->text + buffer->length, text, length);
+  buffer->length += length;
+  return true;
+}
+
+static struct SOURCE* buffer_source(SOURCE_BUFFER* buffer)
+{
+  struct SOURCE* source = new SOURCE;
+
+  source->text = (buffer->text != NULL) ? buffer->text : (char*) calloc(1, 1);
+  source->length = buffer->length;
+  source->mapped = NULL;
+  source->size = 0;
+
+  return source;
+}
+
+
+//
+// source_open
+//
+struct SOURCE* source_open(const char* filename)
+{
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+
+  struct stat st;
+
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    size_t size = (size_t) st.st_size;
+    void* mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (mapped != MAP_FAILED) {
+      close(fd);
+      madvise(mapped, size, MADV_SEQUENTIAL);
+
+      struct SOURCE* source = new SOURCE;
+      source->text = (const char*) mapped;
+      source->length = size;
+      source->mapped = mapped;
+      source->size = size;
+
+      return source;
+    }
+  }
+
+  //
+  // empty, or not something that can be mapped (a pipe, say), so
+  // read it:
+  //
+  SOURCE_BUFFER buffer = { NULL, 0, 0 };
+  char block[64 * 1024];
+  ssize_t n;
+
+  while ((n = read(fd, block, sizeof(block))) > 0) {
+    if (!buffer_append(&buffer, block, (size_t) n)) {
+      close(fd);
+      return NULL;
+    }
+  }
+
+  close(fd);
+  return buffer_source(&buffer);
+}
+
+
+//
+// line_ends_program
+//
+// Does the scanner find a $ on this line? Not inside a string
+// literal or a comment; nothing carries over from one line to the
+// next, so each line can be checked on its own.
+//
+static bool line_ends_program(const char* line, size_t length)
+{
+  const char* end = line + length;
+
+  for (const char* p = line; p < end; p++) {
+    if (*p == '$')
+      return true;
+
+    if (*p == '#')
+      return false;
+
+    if (*p == '"' || *p == '\'') {
+      const char* close = (const char*) memchr(p + 1, *p, end - (p + 1));
+      if (close == NULL)
+        return false;
+      p = close;
+    }
+  }
+
+  return false;
+}
+
+
+//
+// source_read_stdin
+//
+struct SOURCE* source_read_stdin(void)
+{
+  SOURCE_BUFFER buffer = { NULL, 0, 0 };
+
+  char*  line = NULL;
+  size_t capacity = 0;
+  ssize_t n;
+
+  while ((n = getline(&line, &capacity, stdin)) > 0) {
+    if (!buffer_append(&buffer, line, (size_t) n)) {
+      free(line);
+      return NULL;
+    }
+
+    if (line_ends_program(line, (size_t) n))
+      break;
+  }
+
+  free(line);
+  return buffer_source(&buffer);
+}
+
+
+//
+// source_destroy
+//
+void source_destroy(struct SOURCE* source)
+{
+  if (source->mapped != NULL)
+    munmap(source->mapped, source->size);
+  else
+    free((char*) source->text);
+
+  delete source;
+}
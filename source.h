@@ -0,0 +1,52 @@
+/*source.h*/
+
+//
+// The text of a nuPython program, held in one contiguous buffer for
+// syntax_parse() and the lexer. A program in a file is mapped into
+// memory rather than read; a program typed at the keyboard (or piped
+// in) is read from stdin into a buffer that grows as needed, up to
+// and including the line with the $ that ends it, so whatever follows
+// on stdin is left for the debugger's commands.
+//
+
+#pragma once
+
+#include <stddef.h>
+
+
+struct SOURCE
+{
+  const char* text;    // the program, not NUL terminated
+  size_t      length;  // number of characters in text
+
+  void*       mapped;  // the mapping text points into, NULL if text was read
+  size_t      size;    // size of the mapping
+};
+
+
+//
+// Public functions:
+//
+
+//
+// source_open
+//
+// Returns the program in the given file, or NULL if the file can't
+// be opened (or there's no memory to read it into). Call source_destroy() to free it.
+//
+struct SOURCE* source_open(const char* filename);
+
+//
+// source_read_stdin
+//
+// Returns the program typed (or piped) in on stdin: the lines up to
+// and including the one where a $ ends the program, or everything
+// up to EOF, or NULL if there's no memory to read it into. Call
+// source_destroy() to free it.
+//
+struct SOURCE* source_read_stdin(void);
+
+//
+// source_destroy
+//
+void source_destroy(struct SOURCE* source);
@@ -0,0 +1,596 @@
+/*stepper.cpp*/
+
+//
+// Bounded, non-mutating execution of nuPython program graphs. See
+// stepper.h.
+//
+// execute() runs a statement and then everything reachable from its
+// next_stmt. To run exactly one statement without cutting the graph,
+// the statement is copied onto the stack with next_stmt = NULL and
+// the copy is executed; the cursor then moves to the original
+// next_stmt. A while loop is stepped by evaluating its condition with
+// execute_expr(): the cursor moves into the body or past the loop.
+// The last statement of a loop body links back to the loop, so a
+// cursor inside a body finds its way back to the condition by
+// itself.
+//
+// Continuing to a flagged line copies whole stretches instead: the
+// statements up to the next loop or flagged line, linked copy to
+// copy, go to execute() in one call, and only loop conditions are
+// evaluated one at a time. Once no flagged line can be reached,
+// execute() runs the rest of the program.
+//
+// With a journal, each statement is recorded before it runs: its
+// line, and for an assignment the old value of the cell it is about
+// to write (or, if the write creates the cell, the new cell's
+// address). Continuing then takes straight stretches, with no loop
+// in them and no cell written twice, so that every old value is
+// known before the stretch runs: they're recorded, and the stretch
+// goes to execute() in one call.
+//
+
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "stepper.h"
+#include "journal.h"
+
+using namespace std;
+
+
+#define STRETCH_MAX 64  // statements recorded and executed at a time, with a journal
+
+//
+// the statement struct of an assignment, function call or pass,
+// which is what gets copied:
+//
+union STMT_PART
+{
+  struct STMT_ASSIGNMENT assignment;
+  struct STMT_FUNCTION_CALL function_call;
+  struct STMT_PASS pass;
+};
+
+//
+// copies the assignment, function call or pass stmt into *copy, its
+// statement struct into *part, with next_stmt = NULL; returns the
+// stmt's own next_stmt:
+//
+static struct STMT* copy_stmt(struct STMT* stmt, struct STMT* copy, union STMT_PART* part)
+{
+  *copy = *stmt;
+
+  if (stmt->stmt_type == STMT_ASSIGNMENT) {
+    part->assignment = *stmt->types.assignment;
+    part->assignment.next_stmt = NULL;
+    copy->types.assignment = &part->assignment;
+    return stmt->types.assignment->next_stmt;
+  }
+  else if (stmt->stmt_type == STMT_FUNCTION_CALL) {
+    part->function_call = *stmt->types.function_call;
+    part->function_call.next_stmt = NULL;
+    copy->types.function_call = &part->function_call;
+    return stmt->types.function_call->next_stmt;
+  }
+  else {
+    part->pass = *stmt->types.pass;
+    part->pass.next_stmt = NULL;
+    copy->types.pass = &part->pass;
+    return stmt->types.pass->next_stmt;
+  }
+}
+
+//
+// sets the next_stmt of a copy made by copy_stmt():
+//
+static void link_copy(struct STMT* copy, struct STMT* next)
+{
+  if (copy->stmt_type == STMT_ASSIGNMENT)
+    copy->types.assignment->next_stmt = next;
+  else if (copy->stmt_type == STMT_FUNCTION_CALL)
+    copy->types.function_call->next_stmt = next;
+  else
+    copy->types.pass->next_stmt = next;
+}
+
+//
+// executes the single statement stmt, setting *next to the
+// statement that executes next (NULL at the end of the program):
+//
+static struct ExecuteResult execute_one(struct STMT* stmt, struct RAM* memory, struct STMT** next)
+{
+  struct ExecuteResult result;
+  result.Success = true;
+  result.LastStmt = stmt;
+
+  *next = NULL;
+
+  if (stmt->stmt_type == STMT_WHILE_LOOP) {
+    struct STMT_WHILE_LOOP* loop = stmt->types.while_loop;
+    struct RAM_VALUE* value = execute_expr(stmt, memory, loop->condition);
+
+    if (value == NULL) {  // error msg already output:
+      result.Success = false;
+      return result;
+    }
+
+    //
+    // like execute(), the condition is tested via its integer field:
+    //
+    *next = (value->types.i != 0) ? loop->loop_body : loop->next_stmt;
+
+    ram_free_value(value);
+    return result;
+  }
+
+  if (stmt->stmt_type == STMT_IF_THEN_ELSE) {
+    //
+    // programgraph_build() does not produce these yet, so let
+    // execute() take it and the rest of the program:
+    //
+    return execute(stmt, memory);
+  }
+
+  struct STMT copy;
+  union STMT_PART part;
+
+  *next = copy_stmt(stmt, &copy, &part);
+
+  result = execute(&copy, memory);
+
+  result.LastStmt = stmt;  // report the original, not the copy
+  if (!result.Success)
+    *next = NULL;
+
+  return result;
+}
+
+
+//
+// execute_one, recording the statement in the journal first (if
+// there is one):
+//
+static struct ExecuteResult execute_journaled(struct STMT* stmt, struct RAM* memory,
+                                              struct JOURNAL* journal, struct STMT** next)
+{
+  if (journal == NULL)
+    return execute_one(stmt, memory, next);
+
+  journal_begin(journal, stmt->line);
+
+  if (stmt->stmt_type != STMT_ASSIGNMENT)
+    return execute_one(stmt, memory, next);
+
+  //
+  // the cell written is either the variable, or for *p = ... the
+  // cell p points to:
+  //
+  struct STMT_ASSIGNMENT* assign = stmt->types.assignment;
+  int addr = ram_get_addr(memory, assign->var_name);
+
+  if (assign->isPtrDeref) {
+    const struct RAM_VALUE* ptr = ram_peek_by_addr(memory, addr);
+    addr = (ptr != NULL && ptr->value_type == RAM_TYPE_PTR) ? ptr->types.i : -1;
+  }
+
+  const struct RAM_VALUE* old = ram_peek_by_addr(memory, addr);
+  if (old != NULL)
+    journal_old_value(journal, addr, old);
+
+  int num_values = memory->num_values;
+  struct ExecuteResult result = execute_one(stmt, memory, next);
+
+  if (old == NULL && memory->num_values > num_values)
+    journal_new_cell(journal, memory->num_values - 1);
+
+  return result;
+}
+
+
+//
+// execute_steps
+//
+struct ExecuteResult execute_steps(struct STMT* stmt, struct RAM* memory, long n,
+                                   struct JOURNAL* journal, struct STMT** next)
+{
+  struct ExecuteResult result;
+  result.Success = true;
+  result.LastStmt = NULL;
+
+  while (stmt != NULL && n != 0)
+  {
+    result = execute_journaled(stmt, memory, journal, &stmt);
+
+    if (!result.Success)
+      break;
+
+    n--;
+  }
+
+  *next = stmt;
+  return result;
+}
+
+
+//
+// helpers for execute_continue():
+//
+
+//
+// the next_stmt of any statement but an if-then-else; for a loop,
+// the statement after it:
+//
+static struct STMT* next_of(struct STMT* stmt)
+{
+  if (stmt->stmt_type == STMT_ASSIGNMENT)
+    return stmt->types.assignment->next_stmt;
+  else if (stmt->stmt_type == STMT_FUNCTION_CALL)
+    return stmt->types.function_call->next_stmt;
+  else if (stmt->stmt_type == STMT_PASS)
+    return stmt->types.pass->next_stmt;
+  else
+    return stmt->types.while_loop->next_stmt;
+}
+
+static bool flagged(struct STMT* stmt, const unsigned char* stop_lines, int num_lines)
+{
+  return stmt->line < num_lines && stop_lines[stmt->line] != 0;
+}
+
+//
+// returns true if a statement on a flagged line can be reached from
+// stmt, stmt itself included:
+//
+static bool flag_reachable(struct STMT* stmt, const unsigned char* stop_lines, int num_lines)
+{
+  unordered_set<struct STMT*> seen;
+  vector<struct STMT*> pending(1, stmt);
+
+  while (!pending.empty()) {
+    struct STMT* s = pending.back();
+    pending.pop_back();
+
+    if (s == NULL || !seen.insert(s).second)
+      continue;
+    if (flagged(s, stop_lines, num_lines))
+      return true;
+
+    if (s->stmt_type == STMT_IF_THEN_ELSE) {
+      pending.push_back(s->types.if_then_else->true_path);
+      pending.push_back(s->types.if_then_else->false_path);
+      continue;
+    }
+
+    if (s->stmt_type == STMT_WHILE_LOOP)
+      pending.push_back(s->types.while_loop->loop_body);
+    pending.push_back(next_of(s));
+  }
+
+  return false;
+}
+
+//
+// returns true if the loop can run to completion without stopping:
+// no statement of the loop (header included) is on a flagged line,
+// and none is an if-then-else:
+//
+static bool loop_clean(struct STMT* loop, const unsigned char* stop_lines, int num_lines)
+{
+  unordered_set<struct STMT*> seen;
+  vector<struct STMT*> pending(1, loop);
+
+  while (!pending.empty()) {
+    struct STMT* s = pending.back();
+    pending.pop_back();
+
+    if (s == NULL || !seen.insert(s).second)
+      continue;
+    if (flagged(s, stop_lines, num_lines) || s->stmt_type == STMT_IF_THEN_ELSE)
+      return false;
+
+    if (s->stmt_type == STMT_WHILE_LOOP)
+      pending.push_back(s->types.while_loop->loop_body);
+    if (s != loop)
+      pending.push_back(next_of(s));
+  }
+
+  return true;
+}
+
+//
+// A stretch: a copy of the statements execute() can run from a given
+// statement on without anything to stop for. It takes in the
+// statements reachable from the first one, up to (and without) the
+// statements on flagged lines, if-then-else statements and loops
+// that aren't clean (see loop_clean()); links to those are NULL in
+// the copy, so execute() returns there. Clean loops are copied whole.
+// The first statement is taken in even if its line is flagged.
+//
+struct STRETCH
+{
+  struct STMT* head;  // copy of the first statement, NULL if it's an if or a loop that isn't clean
+
+  deque<struct STMT> stmts;
+  deque<union STMT_PART> parts;
+  deque<struct STMT_WHILE_LOOP> loops;
+
+  unordered_map<struct STMT*, struct STMT*> originals;  // copy -> original
+};
+
+static void build_stretch(struct STRETCH* stretch, struct STMT* first,
+                          const unsigned char* stop_lines, int num_lines)
+{
+  unordered_map<struct STMT*, struct STMT*> copies;  // original -> copy
+  vector<struct STMT*> pending;
+
+  //
+  // the copy of a statement, made the first time it's needed; NULL
+  // for the statements the stretch stops at:
+  //
+  auto copy_of = [&](struct STMT* s) -> struct STMT* {
+    if (s == NULL)
+      return NULL;
+
+    auto existing = copies.find(s);
+    if (existing != copies.end())
+      return existing->second;
+
+    if ((s != first && flagged(s, stop_lines, num_lines)) || s->stmt_type == STMT_IF_THEN_ELSE ||
+        (s->stmt_type == STMT_WHILE_LOOP && !loop_clean(s, stop_lines, num_lines)))
+      return NULL;
+
+    stretch->stmts.push_back(*s);
+    struct STMT* copy = &stretch->stmts.back();
+
+    if (s->stmt_type == STMT_WHILE_LOOP) {
+      stretch->loops.push_back(*s->types.while_loop);
+      copy->types.while_loop = &stretch->loops.back();
+    }
+    else {
+      stretch->parts.emplace_back();
+      copy_stmt(s, copy, &stretch->parts.back());
+    }
+
+    copies[s] = copy;
+    stretch->originals[copy] = s;
+    pending.push_back(s);
+    return copy;
+  };
+
+  stretch->head = copy_of(first);
+
+  while (!pending.empty()) {
+    struct STMT* s = pending.back();
+    pending.pop_back();
+
+    struct STMT* copy = copies[s];
+
+    if (s->stmt_type == STMT_WHILE_LOOP) {
+      struct STMT* body = copy_of(s->types.while_loop->loop_body);
+      struct STMT* next = copy_of(s->types.while_loop->next_stmt);
+
+      copy->types.while_loop->loop_body = body;
+      copy->types.while_loop->next_stmt = next;
+    }
+    else
+      link_copy(copy, copy_of(next_of(s)));
+  }
+}
+
+//
+// executes the stretch from stmt in one call to execute(), setting
+// *next like execute_one(). Stretches are built the first time
+// they're needed and kept in stretches.
+//
+static struct ExecuteResult execute_stretch(struct STMT* stmt, struct RAM* memory,
+                                            const unsigned char* stop_lines, int num_lines,
+                                            unordered_map<struct STMT*, struct STRETCH>& stretches,
+                                            struct STMT** next)
+{
+  auto found = stretches.find(stmt);
+
+  if (found == stretches.end()) {
+    found = stretches.emplace(stmt, STRETCH()).first;
+    build_stretch(&found->second, stmt, stop_lines, num_lines);
+  }
+
+  struct STRETCH* stretch = &found->second;
+
+  if (stretch->head == NULL)
+    return execute_one(stmt, memory, next);
+
+  struct ExecuteResult result = execute(stretch->head, memory);
+
+  //
+  // report the original, not the copy; the program goes on after
+  // the last statement executed (a loop executes last when its
+  // condition is false):
+  //
+  result.LastStmt = stretch->originals[result.LastStmt];
+
+  if (!result.Success)
+    *next = NULL;
+  else
+    *next = next_of(result.LastStmt);
+
+  return result;
+}
+
+
+//
+// executes a straight stretch in one call to execute(), recording
+// its statements in the journal first: stmt, and the assignments,
+// function calls and passes after it, up to the first loop, flagged
+// line or statement that writes a cell written earlier in the
+// stretch (or through a pointer written earlier), at most
+// STRETCH_MAX in all. No cell is written twice, so each statement's
+// old value is the cell's value before the stretch runs. Sets *next
+// like execute_one().
+//
+static struct ExecuteResult execute_journaled_stretch(struct STMT* stmt, struct RAM* memory,
+                                                      const unsigned char* stop_lines, int num_lines,
+                                                      struct JOURNAL* journal, struct STMT** next)
+{
+  if (stmt->stmt_type == STMT_WHILE_LOOP || stmt->stmt_type == STMT_IF_THEN_ELSE)
+    return execute_journaled(stmt, memory, journal, next);
+
+  struct STMT* originals[STRETCH_MAX];
+  struct STMT copies[STRETCH_MAX];
+  union STMT_PART parts[STRETCH_MAX];
+  bool new_cells[STRETCH_MAX];  // recorded as creating a cell
+
+  int written[STRETCH_MAX];          // cells the stretch writes
+  const char* created[STRETCH_MAX];  // variables it creates, in order
+  int num_written = 0, num_created = 0;
+  int num_values = memory->num_values;
+  int n = 0;
+
+  struct STMT* s = stmt;
+
+  auto was_written = [&](int addr) { return find(written, written + num_written, addr) != written + num_written; };
+  auto was_created = [&](const char* name) {
+    for (int i = 0; i < num_created; i++)
+      if (strcmp(created[i], name) == 0)
+        return true;
+    return false;
+  };
+
+  while (n < STRETCH_MAX && s != NULL && s->stmt_type != STMT_WHILE_LOOP &&
+         s->stmt_type != STMT_IF_THEN_ELSE && (n == 0 || !flagged(s, stop_lines, num_lines)))
+  {
+    int addr = -1;
+    bool creates = false;
+
+    if (s->stmt_type == STMT_ASSIGNMENT) {
+      //
+      // the cell written is either the variable, or for *p = ... the
+      // cell p points to:
+      //
+      struct STMT_ASSIGNMENT* assign = s->types.assignment;
+
+      if (was_created(assign->var_name))
+        break;
+
+      addr = ram_get_addr(memory, assign->var_name);
+
+      if (addr >= 0 && assign->isPtrDeref) {
+        if (was_written(addr))
+          break;
+
+        const struct RAM_VALUE* ptr = ram_peek_by_addr(memory, addr);
+        addr = (ptr != NULL && ptr->value_type == RAM_TYPE_PTR) ? ptr->types.i : -1;
+      }
+
+      if (addr >= 0 && was_written(addr))
+        break;
+
+      creates = (addr < 0 && !assign->isPtrDeref);
+    }
+
+    journal_begin(journal, s->line);
+    new_cells[n] = false;
+
+    if (addr >= 0) {
+      const struct RAM_VALUE* old = ram_peek_by_addr(memory, addr);
+      if (old != NULL)
+        journal_old_value(journal, addr, old);
+      written[num_written++] = addr;
+    }
+    else if (creates) {
+      journal_new_cell(journal, num_values + num_created);
+      created[num_created++] = s->types.assignment->var_name;
+      new_cells[n] = true;
+    }
+
+    originals[n] = s;
+    s = copy_stmt(s, &copies[n], &parts[n]);
+
+    if (n > 0)
+      link_copy(&copies[n - 1], &copies[n]);
+    n++;
+  }
+
+  struct ExecuteResult result = execute(&copies[0], memory);
+
+  if (result.Success) {
+    result.LastStmt = originals[n - 1];
+    *next = s;
+    return result;
+  }
+
+  //
+  // the statements after the one that failed never ran, and it
+  // didn't create its cell:
+  //
+  int failed = (int) (result.LastStmt - copies);
+  struct JOURNAL_RECORD record;
+
+  for (int i = n - 1; i > failed; i--)
+    journal_pop(journal, &record);
+
+  if (new_cells[failed]) {
+    journal_pop(journal, &record);
+    journal_begin(journal, originals[failed]->line);
+  }
+
+  result.LastStmt = originals[failed];  // the original, not the copy
+  *next = NULL;
+  return result;
+}
+
+
+//
+// execute_continue
+//
+struct ExecuteResult execute_continue(struct STMT* stmt, struct RAM* memory,
+                                      const unsigned char* stop_lines, int num_lines,
+                                      struct JOURNAL* journal, struct STMT** next)
+{
+  //
+  // nothing reachable to stop at, and nothing to record? Then
+  // execute() can run the rest natively, which is correct from any
+  // cursor, loop bodies included:
+  //
+  if (journal == NULL && !flag_reachable(stmt, stop_lines, num_lines)) {
+    *next = NULL;
+    return execute(stmt, memory);
+  }
+
+  //
+  // otherwise stretches go to execute() and loop conditions are
+  // evaluated here. What can be reached only shrinks when a loop is
+  // left, so that's where it's checked again, once per loop:
+  //
+  unordered_set<struct STMT*> exits_checked;
+  unordered_map<struct STMT*, struct STRETCH> stretches;
+  struct ExecuteResult result;
+
+  while (true)
+  {
+    struct STMT* stmt_executed = stmt;
+
+    if (journal != NULL)
+      result = execute_journaled_stretch(stmt, memory, stop_lines, num_lines, journal, &stmt);
+    else
+      result = execute_stretch(stmt, memory, stop_lines, num_lines, stretches, &stmt);
+
+    if (!result.Success || stmt == NULL || flagged(stmt, stop_lines, num_lines))
+      break;
+
+    if (journal == NULL && stmt_executed->stmt_type == STMT_WHILE_LOOP &&
+        stmt == stmt_executed->types.while_loop->next_stmt &&
+        exits_checked.insert(stmt_executed).second &&
+        !flag_reachable(stmt, stop_lines, num_lines)) {
+      *next = NULL;
+      return execute(stmt, memory);
+    }
+  }
+
+  *next = stmt;
+  return result;
+}
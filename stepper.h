@@ -0,0 +1,59 @@
+/*stepper.h*/
+
+//
+// Executes a nuPython program graph a bounded number of statements
+// at a time, without modifying the graph. Where execute() runs the
+// program to completion, these functions stop after N statements (or
+// before a flagged line) and return a cursor: the statement that
+// executes next. The cursor can be any statement in the graph,
+// including one inside a loop body, and execution resumes from it
+// by passing it back in.
+//
+// Since the graph is only read, one program graph can be shared by
+// any number of cursors (debugging sessions, threads), each with its
+// own memory.
+//
+
+#pragma once
+
+#include "programgraph.h"
+#include "ram.h"
+#include "execute.h"
+#include "journal.h"
+
+
+//
+// Public functions:
+//
+
+//
+// execute_steps
+//
+// Executes at most n statements of the program, starting with the
+// given stmt (n < 0 => no limit). A while loop counts as one
+// statement each time its condition is evaluated; the statements of
+// its body are counted individually. On return, *next is the
+// statement that executes next, or NULL if the program has
+// completed. Returns the same way as execute(): {false, stmt where
+// the error occurred} after a semantic error, otherwise {true, last
+// stmt executed}. If journal is not NULL, every statement executed is
+// recorded in it, so it can be undone (see journal.h).
+//
+struct ExecuteResult execute_steps(struct STMT* stmt, struct RAM* memory, long n,
+                                   struct JOURNAL* journal, struct STMT** next);
+
+//
+// execute_continue
+//
+// Executes the program starting with the given stmt, and keeps going
+// until the next statement to execute is on a line flagged in
+// stop_lines (stop_lines[line] != 0, for lines less than num_lines),
+// or the program completes. The given stmt itself is always executed.
+// The statements between loop conditions are handed to execute() a
+// stretch at a time, and without a journal, once no flagged line can
+// be reached, the rest of the program is handed to execute() in one
+// call. Returns and records the same way as execute_steps().
+//
+struct ExecuteResult execute_continue(struct STMT* stmt, struct RAM* memory,
+                                      const unsigned char* stop_lines, int num_lines,
+                                      struct JOURNAL* journal, struct STMT** next);
@@ -0,0 +1,157 @@
+/*strbench.cpp*/
+
+//
+// String kernel benchmark: times equality, comparison and substring
+// search on strings of increasing length, with the C library calls
+// the string operators used so far (strcmp, and strstr for search)
+// and with strops.cpp: strops_equal() and strops_compare(), and each
+// search kernel set this CPU supports:
+//
+//     make strbench
+//     ./strbench [repeat]
+//
+// The two strings compared are the same but for their last
+// character, and the needles searched for sit at the end of the
+// haystack, so every call looks at every byte. One needle starts with
+// a character the haystack never has ("find"), the other with one
+// it has every 26 bytes ("find-a"), which is where searching for the
+// first character alone (memchr) stalls. Each timing is the best of
+// repeat runs, reported in nanoseconds per call and in GB/s of
+// string scanned.
+//
+
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "strops.h"
+
+using namespace std;
+
+
+#define BYTES_PER_RUN (64L * 1024 * 1024)  // calls per run scale with 1/length
+#define NEEDLE_LENGTH 8
+
+static volatile long sink;  // keeps the calls from being optimized away
+
+//
+// hides p from the optimizer, so a call on it can't be hoisted out
+// of the timing loop:
+//
+static inline const char* opaque(const char* p)
+{
+  asm volatile("" : "+r"(p));
+  return p;
+}
+
+
+struct CASE
+{
+  const char* a;
+  const char* b;  // a, but for the last character
+  size_t length;
+  const char* needle;  // the last NEEDLE_LENGTH characters of a
+  const char* needle_a;  // the NEEDLE_LENGTH + 1 last, starting with 'a'
+};
+
+//
+// best of repeat runs of calls calls, in nanoseconds per call:
+//
+template <typename F>
+static double best_time(F call, long calls, int repeat)
+{
+  double best = 0;
+
+  for (int i = 0; i < repeat; i++) {
+    long total = 0;
+
+    auto start = chrono::steady_clock::now();
+    for (long j = 0; j < calls; j++)
+      total += call();
+    auto stop = chrono::steady_clock::now();
+
+    sink = total;
+
+    double ns = chrono::duration<double, nano>(stop - start).count() / calls;
+    if (i == 0 || ns < best)
+      best = ns;
+  }
+
+  return best;
+}
+
+static void report(const char* op, const char* name, size_t length, double ns)
+{
+  printf("%-8s %-8s %9zu bytes  %12.1f ns  %8.2f GB/s\n", op, name, length, ns, length / ns);
+}
+
+
+//
+// main
+//
+// usage: ./strbench [repeat]
+//
+int main(int argc, char* argv[])
+{
+  int repeat = (argc > 1) ? atoi(argv[1]) : 5;
+  if (repeat < 1)
+    repeat = 1;
+
+  int count;
+  const struct STROPS_KERNELS* kernels = strops_kernels(&count);
+
+  printf("kernel sets:");
+  for (int k = 0; k < count; k++)
+    printf(" %s", kernels[k].name);
+  printf(" (using %s), best of %d\n", kernels[count - 1].name, repeat);
+
+  const size_t lengths[] = { 16, 64, 256, 1024, 4096, 65536, 1048576 };
+
+  for (size_t length : lengths) {
+    //
+    // text without the needle anywhere but at its end:
+    //
+    string a(length, ' ');
+    for (size_t i = 0; i < length; i++)
+      a[i] = "abcdefghijklmnopqrstuvwxyz"[(i * 7) % 26];
+    a.replace(length - NEEDLE_LENGTH - 1, NEEDLE_LENGTH + 1, "aNEEDLE!!");
+
+    string b = a;
+    b[length - 1] = '?';
+
+    CASE c = { a.c_str(), b.c_str(), length, a.c_str() + length - NEEDLE_LENGTH, a.c_str() + length - NEEDLE_LENGTH - 1 };
+    long calls = BYTES_PER_RUN / (long) length;
+    double ns;
+
+    ns = best_time([&]() { return (long) (strcmp(opaque(c.a), c.b) == 0); }, calls, repeat);
+    report("equal", "strcmp", length, ns);
+    ns = best_time([&]() { return (long) strops_equal(opaque(c.a), c.length, c.b, c.length); }, calls, repeat);
+    report("equal", "strops", length, ns);
+
+    ns = best_time([&]() { return (long) strcmp(opaque(c.a), c.b); }, calls, repeat);
+    report("compare", "strcmp", length, ns);
+    ns = best_time([&]() { return (long) strops_compare(opaque(c.a), c.length, c.b, c.length); }, calls, repeat);
+    report("compare", "strops", length, ns);
+
+    ns = best_time([&]() { return (long) (strstr(opaque(c.a), c.needle) - c.a); }, calls, repeat);
+    report("find", "strstr", length, ns);
+    for (int k = 0; k < count; k++) {
+      ns = best_time([&]() { return kernels[k].find(c.a, c.length, c.needle, NEEDLE_LENGTH); }, calls, repeat);
+      report("find", kernels[k].name, length, ns);
+    }
+
+    ns = best_time([&]() { return (long) (strstr(opaque(c.a), c.needle_a) - c.a); }, calls, repeat);
+    report("find-a", "strstr", length, ns);
+    for (int k = 0; k < count; k++) {
+      ns = best_time([&]() { return kernels[k].find(c.a, c.length, c.needle_a, NEEDLE_LENGTH + 1); }, calls, repeat);
+      report("find-a", kernels[k].name, length, ns);
+    }
+
+    printf("\n");
+  }
+
+  return 0;
+}
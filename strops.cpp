@@ -0,0 +1,404 @@
+/*strops.cpp*/
+
+//
+// Vectorized string kernels. See strops.h.
+//
+// The SSE2 and AVX2 kernels are compiled for their instruction set
+// with target attributes, so the rest of the program is built for
+// the baseline CPU and never runs them unless CPUID says it can.
+//
+// Equality and comparison are memcmp() on the known lengths: the C
+// library's memcmp is itself vectorized and chosen by CPU, and it
+// measured as fast as or faster than kernels of our own at every
+// length but the shortest (see strbench.cpp), where the call costs
+// more than the comparing. So strings of at most 16 bytes are
+// compared a word at a time inline instead, and on x86-64 those of at
+// most 64 bytes 16 at a time (SSE2).
+//
+// Substring search looks for the needle's first character with
+// memchr() and compares the rest where it's found. That is the
+// fastest search there is while the character is rare in the text,
+// but it stalls where the character is common. So the vector kernels
+// watch how often a found character leads nowhere, and once it's
+// more than about once per STROPS_DENSE bytes they switch to testing
+// the needle's first and last characters against a whole block of
+// positions at once, comparing in full only where both match.
+//
+
+#include <cstring>
+
+#include "strops.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define STROPS_X86 1
+#include <immintrin.h>
+#else
+#define STROPS_X86 0
+#endif
+
+using namespace std;
+
+
+#define STROPS_DENSE 64   // bytes per false start of a memchr() search at which blocks are faster
+#define STROPS_PATIENCE 8 // false starts before giving up on memchr()
+
+
+//
+// scalar kernel, also used (inline) for the short haystacks and the
+// tails of the vector ones:
+//
+__attribute__((always_inline))
+static inline long find_scalar(const char* haystack, size_t haystack_length, const char* needle, size_t needle_length)
+{
+  if (needle_length > haystack_length)
+    return -1;
+
+  const char* p = haystack;
+  const char* end = haystack + haystack_length - needle_length + 1;  // past the last candidate
+
+  while (p < end) {
+    p = (const char*) memchr(p, needle[0], end - p);
+    if (p == NULL)
+      return -1;
+
+    if (memcmp(p + 1, needle + 1, needle_length - 1) == 0)
+      return p - haystack;
+
+    p++;
+  }
+
+  return -1;
+}
+
+
+#if STROPS_X86
+
+//
+// the candidate positions at, at + 1, ... flagged in candidates
+// where the needle's first and last characters match; returns the
+// first where the rest matches too, -1 if none (kept out of line so
+// the search loops keep their vectors in registers):
+//
+__attribute__((noinline))
+static long find_verify(const char* haystack, size_t at, unsigned long long candidates,
+                        const char* needle, size_t needle_length)
+{
+  while (candidates != 0) {
+    size_t i = at + __builtin_ctzll(candidates);
+
+    if (memcmp(haystack + i + 1, needle + 1, needle_length - 2) == 0)
+      return (long) i;
+
+    candidates &= candidates - 1;
+  }
+
+  return -1;
+}
+
+//
+// find_scalar() until the needle's first character has been found
+// STROPS_PATIENCE times and on average more than once every
+// STROPS_DENSE bytes without the rest matching. Returns the index
+// found, -1 if there is none, or -2 if it gave up, with *resume the
+// position to go on searching from.
+//
+static long find_sparse(const char* haystack, size_t haystack_length, const char* needle, size_t needle_length,
+                        size_t* resume)
+{
+  const char* p = haystack;
+  const char* end = haystack + haystack_length - needle_length + 1;  // past the last candidate
+  size_t false_starts = 0;
+
+  while (p < end) {
+    p = (const char*) memchr(p, needle[0], end - p);
+    if (p == NULL)
+      return -1;
+
+    if (memcmp(p + 1, needle + 1, needle_length - 1) == 0)
+      return p - haystack;
+
+    p++;
+    false_starts++;
+
+    if (false_starts >= STROPS_PATIENCE && (size_t) (p - haystack) < false_starts * STROPS_DENSE) {
+      *resume = p - haystack;
+      return -2;
+    }
+  }
+
+  return -1;
+}
+
+//
+// SSE2 kernels, 64 bytes per iteration:
+//
+//
+// bit j set if haystack[at + j] and haystack[at + j + last] match
+// first and the needle's last character:
+//
+static inline unsigned match_sse2(const char* haystack, size_t at, size_t last, __m128i first_char, __m128i last_char)
+{
+  __m128i block_first = _mm_loadu_si128((const __m128i*) (haystack + at));
+  __m128i block_last = _mm_loadu_si128((const __m128i*) (haystack + at + last));
+
+  return (unsigned) _mm_movemask_epi8(
+    _mm_and_si128(_mm_cmpeq_epi8(first_char, block_first), _mm_cmpeq_epi8(last_char, block_last)));
+}
+
+static long find_sse2(const char* haystack, size_t haystack_length, const char* needle, size_t needle_length)
+{
+  if (needle_length > haystack_length)
+    return -1;
+  if (needle_length == 1 || haystack_length < STROPS_PATIENCE * STROPS_DENSE)
+    return find_scalar(haystack, haystack_length, needle, needle_length);
+
+  size_t i;
+  long   found = find_sparse(haystack, haystack_length, needle, needle_length, &i);
+
+  if (found != -2)
+    return found;
+
+  __m128i first_char = _mm_set1_epi8(needle[0]);
+  __m128i last_char = _mm_set1_epi8(needle[needle_length - 1]);
+  size_t  last = needle_length - 1;
+
+  for (; i + last + 64 <= haystack_length; i += 64) {
+    unsigned long long candidates =
+      (unsigned long long) match_sse2(haystack, i, last, first_char, last_char) |
+      (unsigned long long) match_sse2(haystack, i + 16, last, first_char, last_char) << 16 |
+      (unsigned long long) match_sse2(haystack, i + 32, last, first_char, last_char) << 32 |
+      (unsigned long long) match_sse2(haystack, i + 48, last, first_char, last_char) << 48;
+
+    if (candidates != 0) {
+      found = find_verify(haystack, i, candidates, needle, needle_length);
+      if (found >= 0)
+        return found;
+    }
+  }
+
+  found = find_scalar(haystack + i, haystack_length - i, needle, needle_length);
+  return (found < 0) ? -1 : (long) i + found;
+}
+
+//
+// AVX2 kernels, the same 32 bytes at a time:
+//
+__attribute__((target("avx2")))
+static inline unsigned match_avx2(const char* haystack, size_t at, size_t last, __m256i first_char, __m256i last_char)
+{
+  __m256i block_first = _mm256_loadu_si256((const __m256i*) (haystack + at));
+  __m256i block_last = _mm256_loadu_si256((const __m256i*) (haystack + at + last));
+
+  return (unsigned) _mm256_movemask_epi8(
+    _mm256_and_si256(_mm256_cmpeq_epi8(first_char, block_first), _mm256_cmpeq_epi8(last_char, block_last)));
+}
+
+__attribute__((target("avx2")))
+static long find_avx2(const char* haystack, size_t haystack_length, const char* needle, size_t needle_length)
+{
+  if (needle_length > haystack_length)
+    return -1;
+  if (needle_length == 1 || haystack_length < STROPS_PATIENCE * STROPS_DENSE)
+    return find_scalar(haystack, haystack_length, needle, needle_length);
+
+  size_t i;
+  long   found = find_sparse(haystack, haystack_length, needle, needle_length, &i);
+
+  if (found != -2)
+    return found;
+
+  __m256i first_char = _mm256_set1_epi8(needle[0]);
+  __m256i last_char = _mm256_set1_epi8(needle[needle_length - 1]);
+  size_t  last = needle_length - 1;
+
+  for (; i + last + 64 <= haystack_length; i += 64) {
+    unsigned long long candidates =
+      (unsigned long long) match_avx2(haystack, i, last, first_char, last_char) |
+      (unsigned long long) match_avx2(haystack, i + 32, last, first_char, last_char) << 32;
+
+    if (candidates != 0) {
+      found = find_verify(haystack, i, candidates, needle, needle_length);
+      if (found >= 0)
+        return found;
+    }
+  }
+
+  found = find_scalar(haystack + i, haystack_length - i, needle, needle_length);
+  return (found < 0) ? -1 : (long) i + found;
+}
+
+#endif
+
+
+//
+// the kernel sets this CPU supports, the best last:
+//
+struct STROPS_TABLE
+{
+  STROPS_KERNELS sets[3];
+  int count;
+};
+
+static STROPS_TABLE strops_select()
+{
+  STROPS_TABLE table;
+
+  table.sets[0] = { "scalar", find_scalar };
+  table.count = 1;
+
+#if STROPS_X86
+  table.sets[table.count++] = { "sse2", find_sse2 };  // part of x86-64
+
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    table.sets[table.count++] = { "avx2", find_avx2 };
+#endif
+
+  return table;
+}
+
+static const STROPS_TABLE table = strops_select();
+static const STROPS_KERNELS* best = &table.sets[table.count - 1];
+
+
+//
+// public functions:
+//
+const struct STROPS_KERNELS* strops_kernels(int* count)
+{
+  *count = table.count;
+  return table.sets;
+}
+
+//
+// strings of at most 16 bytes: each is turned into one number whose
+// order is the order of its bytes, as unsigned char -- overlapping
+// big-endian loads of its first and last 8 or 4 bytes, or its first,
+// middle and last byte, which between them cover every byte:
+//
+static inline unsigned long long load64(const char* s)
+{
+  unsigned long long word;
+  memcpy(&word, s, 8);
+  return __builtin_bswap64(word);
+}
+
+static inline unsigned long long load32(const char* s)
+{
+  unsigned int word;
+  memcpy(&word, s, 4);
+  return __builtin_bswap32(word);
+}
+
+static inline unsigned __int128 short_key(const char* s, size_t n)
+{
+  if (n >= 8)
+    return (unsigned __int128) load64(s) << 64 | load64(s + n - 8);
+  if (n >= 4)
+    return load32(s) << 32 | load32(s + n - 4);
+  if (n > 0)
+    return (unsigned char) s[0] << 16 | (unsigned char) s[n / 2] << 8 | (unsigned char) s[n - 1];
+
+  return 0;
+}
+
+__attribute__((always_inline))
+static inline int compare_short(const char* a, const char* b, size_t n)
+{
+  unsigned __int128 x = short_key(a, n);
+  unsigned __int128 y = short_key(b, n);
+
+  return (x > y) - (x < y);
+}
+
+#if STROPS_X86
+
+//
+// strings of 17 to 64 bytes: SSE2 compares of 16 bytes at 0, 16, ...,
+// the last one ending at n (overlapping the one before). The order of
+// the first bytes that differ comes from the same vectors (a's byte
+// is the smaller if it's the minimum of the two), so nothing is read
+// again; returns < 0, 0 or > 0:
+//
+__attribute__((always_inline))
+static inline int compare_block(const char* a, const char* b, size_t at, int* cmp)
+{
+  __m128i x = _mm_loadu_si128((const __m128i*) (a + at));
+  __m128i y = _mm_loadu_si128((const __m128i*) (b + at));
+  unsigned same = (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(x, y));
+
+  if (same == 0xFFFF)
+    return 0;
+
+  unsigned smaller = (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(x, y), x));
+  *cmp = ((smaller >> __builtin_ctz(~same)) & 1) ? -1 : 1;
+  return 1;
+}
+
+__attribute__((always_inline))
+static inline int compare_medium(const char* a, const char* b, size_t n)
+{
+  int cmp = 0;
+
+  if (compare_block(a, b, 0, &cmp))
+    return cmp;
+  for (size_t at = 16; at + 16 < n; at += 16)
+    if (compare_block(a, b, at, &cmp))
+      return cmp;
+  compare_block(a, b, n - 16, &cmp);
+  return cmp;
+}
+
+#define STROPS_MEDIUM 64  // longest string compared inline
+
+#else
+
+#define STROPS_MEDIUM 16
+
+#endif
+
+bool strops_equal(const char* a, size_t a_length, const char* b, size_t b_length)
+{
+  if (a_length != b_length)
+    return false;
+  if (a == b)
+    return true;
+  if (a_length <= 16)
+    return compare_short(a, b, a_length) == 0;
+#if STROPS_X86
+  if (a_length <= STROPS_MEDIUM)
+    return compare_medium(a, b, a_length) == 0;
+#endif
+
+  return memcmp(a, b, a_length) == 0;
+}
+
+int strops_compare(const char* a, size_t a_length, const char* b, size_t b_length)
+{
+  size_t n = (a_length < b_length) ? a_length : b_length;
+  int    cmp;
+
+  if (a == b)
+    cmp = 0;
+  else if (n <= 16)
+    cmp = compare_short(a, b, n);
+#if STROPS_X86
+  else if (n <= STROPS_MEDIUM)
+    cmp = compare_medium(a, b, n);
+#endif
+  else
+    cmp = memcmp(a, b, n);  // bytes as unsigned char, like strcmp
+
+  if (cmp != 0 || a_length == b_length)
+    return cmp;
+
+  return (a_length < b_length) ? -1 : 1;
+}
+
+long strops_find(const char* haystack, size_t haystack_length, const char* needle, size_t needle_length)
+{
+  if (needle_length == 0)
+    return 0;
+
+  return best->find(haystack, haystack_length, needle, needle_length);
+}
@@ -0,0 +1,71 @@
+/*strops.h*/
+
+//
+// String kernels for the string operators: equality, lexicographic
+// comparison (same order as strcmp) and substring search. Strings are
+// given as pointer and length, so nothing scans for a NUL first, and
+// equality of strings whose lengths differ is decided without reading
+// them. Equality and comparison use the C library's memcmp, which is
+// vectorized for the CPU already, but for short strings, compared
+// inline (see strops.cpp).
+//
+// Substring search has kernel sets of its own. On x86-64, where the
+// needle's first character is common in the text, they test 16 (SSE2)
+// or 32 (AVX2) positions at a time; the widest set the CPU supports
+// is chosen at startup, via CPUID. Other machines get the scalar set,
+// which searches with memchr.
+//
+
+#pragma once
+
+#include <stddef.h>
+
+
+struct STROPS_KERNELS
+{
+  const char* name;  // "scalar", "sse2" or "avx2"
+
+  //
+  // index of the first occurrence of the needle_length characters at
+  // needle in the haystack_length characters at haystack, -1 if none
+  // (needle_length > 0):
+  //
+  long (*find)(const char* haystack, size_t haystack_length, const char* needle, size_t needle_length);
+};
+
+
+//
+// Public functions:
+//
+
+//
+// strops_kernels
+//
+// Returns the kernel sets this CPU supports, scalar first and the
+// one in use last, and their number in *count. For benchmarks;
+// strops_find() always uses the best set.
+//
+const struct STROPS_KERNELS* strops_kernels(int* count);
+
+//
+// strops_equal
+//
+// Returns true if the strings are equal.
+//
+bool strops_equal(const char* a, size_t a_length, const char* b, size_t b_length);
+
+//
+// strops_compare
+//
+// Compares the strings the way strcmp does (bytes as unsigned char,
+// a proper prefix first): returns < 0, 0 or > 0.
+//
+int strops_compare(const char* a, size_t a_length, const char* b, size_t b_length);
+
+//
+// strops_find
+//
+// Returns the index of the first occurrence of needle in haystack,
+// -1 if there is none. An empty needle is found at 0.
+//
+long strops_find(const char* haystack, size_t haystack_length, const char* needle, size_t needle_length);
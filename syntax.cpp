@@ -0,0 +1,698 @@
+/*syntax.cpp*/
+
+//
+// Front end for a nuPython program held in memory. See syntax.h.
+//
+// The recursive-descent functions below follow parser_parse()'s
+// grammar, but read the tokens straight from the lexer, through a
+// window of the next two tokens (the most the grammar ever looks
+// ahead), and build the program graph as they go: each returns the
+// nodes for what it matched. The nodes, and copies of the strings
+// they need, are allocated from the graph's arena, so a syntax error
+// just throws the whole graph away.
+//
+// The graph is what programgraph_build() would build from the
+// tokens, and programgraph_build() only ran once the whole program
+// was known to be legal. So what it couldn't build (if statements,
+// for one) isn't an error here; it is noted in the graph for
+// graph_check(), and the rest of the program is still checked.
+//
+// Statement lists and elif chains are loops rather than recursion,
+// so a long program doesn't use up the stack.
+//
+
+#include <cstdio>
+#include <cstring>
+
+#include "syntax.h"
+#include "lexer.h"
+
+using namespace std;
+
+
+struct LEXEME
+{
+  struct Token token;
+  const char*  value;   // not NUL terminated, see lexer_nextToken()
+  size_t       length;
+};
+
+struct SYNTAX
+{
+  struct LEXER lexer;
+  struct LEXEME window[2];       // the next token and the one after it
+  struct PROGRAM_GRAPH* graph;   // being built
+};
+
+
+//
+// the next token and the one after it (once the lexer reaches the
+// end of the program, both are nuPy_EOS):
+//
+static inline const LEXEME& peek(SYNTAX* syntax)
+{
+  return syntax->window[0];
+}
+
+static inline const LEXEME& peek2(SYNTAX* syntax)
+{
+  return syntax->window[1];
+}
+
+static inline void scan(SYNTAX* syntax, LEXEME* lexeme)
+{
+  lexeme->token = lexer_nextToken(&syntax->lexer, &lexeme->value, &lexeme->length);
+}
+
+//
+// moves past the next token:
+//
+static inline void advance(SYNTAX* syntax)
+{
+  syntax->window[0] = syntax->window[1];
+  scan(syntax, &syntax->window[1]);
+}
+
+
+//
+// graph nodes and strings, from the graph's arena:
+//
+template<typename T>
+static inline T* alloc(SYNTAX* syntax)
+{
+  return (T*) arena_alloc(syntax->graph->arena, sizeof(T));
+}
+
+static inline char* copy_value(SYNTAX* syntax, const LEXEME& lexeme)
+{
+  //
+  // a value is a C string as far as the rest of nuPython is concerned,
+  // so it ends at the first NUL, if any:
+  //
+  return arena_copy(syntax->graph->arena, lexeme.value, strnlen(lexeme.value, lexeme.length));
+}
+
+//
+// notes the first thing in the program the graph can't represent:
+//
+static void unsupported(SYNTAX* syntax, const char* msg)
+{
+  if (syntax->graph->unsupported == NULL)
+    syntax->graph->unsupported = msg;
+}
+
+
+//
+// errorMsg
+//
+// Outputs a syntax error message, returns false.
+//
+static bool errorMsg(SYNTAX* syntax, const char* expecting, const LEXEME& found)
+{
+  //
+  // parser_parse() scans the whole program before checking it, so
+  // any warnings about the rest of the program come before the
+  // error; scan the rest to output them:
+  //
+  if (peek2(syntax).token.id != nuPy_EOS) {
+    LEXEME rest;
+
+    do {
+      scan(syntax, &rest);
+    } while (rest.token.id != nuPy_EOS);
+  }
+
+  printf("**SYNTAX ERROR @ (%d,%d): expecting %s, found '%.*s'\n",
+    found.token.line, found.token.col, expecting,
+    (int) strnlen(found.value, found.length), found.value);
+
+  return false;
+}
+
+
+//
+// match
+//
+// If the next token has the given id, moves past it and returns
+// true. Otherwise outputs a syntax error and returns false.
+//
+static bool match(SYNTAX* syntax, int id, const char* expecting)
+{
+  const LEXEME& next = peek(syntax);
+
+  if (next.token.id != id)
+    return errorMsg(syntax, expecting, next);
+
+  advance(syntax);
+  return true;
+}
+
+
+//
+// operatorType
+//
+// The operator the next token stands for, OPERATOR_NO_OP if it isn't
+// a binary operator.
+//
+static int operatorType(SYNTAX* syntax)
+{
+  switch (peek(syntax).token.id)
+  {
+    case nuPy_PLUS:       return OPERATOR_PLUS;
+    case nuPy_MINUS:      return OPERATOR_MINUS;
+    case nuPy_ASTERISK:   return OPERATOR_ASTERISK;
+    case nuPy_POWER:      return OPERATOR_POWER;
+    case nuPy_PERCENT:    return OPERATOR_MOD;
+    case nuPy_SLASH:      return OPERATOR_DIV;
+    case nuPy_EQUALEQUAL: return OPERATOR_EQUAL;
+    case nuPy_NOTEQUAL:   return OPERATOR_NOT_EQUAL;
+    case nuPy_LT:         return OPERATOR_LT;
+    case nuPy_LTE:        return OPERATOR_LTE;
+    case nuPy_GT:         return OPERATOR_GT;
+    case nuPy_GTE:        return OPERATOR_GTE;
+    case nuPy_KEYW_IS:    return OPERATOR_IS;
+    case nuPy_KEYW_IN:    return OPERATOR_IN;
+
+    default:
+      return OPERATOR_NO_OP;
+  }
+}
+
+
+//
+// <op> ::= one of the binary operators
+//
+static bool parser_op(SYNTAX* syntax, int* operator_type)
+{
+  *operator_type = operatorType(syntax);
+
+  if (*operator_type != OPERATOR_NO_OP) {
+    advance(syntax);
+    return true;
+  }
+
+  return errorMsg(syntax, "binary operator such as + or <", peek(syntax));
+}
+
+
+//
+// newElement
+//
+// The element for a token that is an identifier or a literal.
+//
+static struct ELEMENT* newElement(SYNTAX* syntax, const LEXEME& lexeme)
+{
+  ELEMENT* element = alloc<ELEMENT>(syntax);
+
+  switch (lexeme.token.id)
+  {
+    case nuPy_IDENTIFIER:   element->element_type = ELEMENT_IDENTIFIER;   break;
+    case nuPy_INT_LITERAL:  element->element_type = ELEMENT_INT_LITERAL;  break;
+    case nuPy_REAL_LITERAL: element->element_type = ELEMENT_REAL_LITERAL; break;
+    case nuPy_STR_LITERAL:  element->element_type = ELEMENT_STR_LITERAL;  break;
+    case nuPy_KEYW_TRUE:    element->element_type = ELEMENT_TRUE;         break;
+    case nuPy_KEYW_FALSE:   element->element_type = ELEMENT_FALSE;        break;
+    default:                element->element_type = ELEMENT_NONE;         break;
+  }
+
+  element->element_value = copy_value(syntax, lexeme);
+
+  return element;
+}
+
+//
+// isElement
+//
+static bool isElement(SYNTAX* syntax)
+{
+  switch (peek(syntax).token.id)
+  {
+    case nuPy_IDENTIFIER:
+    case nuPy_INT_LITERAL:
+    case nuPy_REAL_LITERAL:
+    case nuPy_STR_LITERAL:
+    case nuPy_KEYW_TRUE:
+    case nuPy_KEYW_FALSE:
+    case nuPy_KEYW_NONE:
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+
+//
+// <element> ::= IDENTIFIER | INT_LITERAL | REAL_LITERAL | STR_LITERAL
+//             | True | False | None
+//
+static bool parser_element(SYNTAX* syntax, struct ELEMENT** element)
+{
+  if (!isElement(syntax))
+    return errorMsg(syntax, "a value such as x, 123, or 'a string'", peek(syntax));
+
+  *element = newElement(syntax, peek(syntax));
+  advance(syntax);
+
+  return true;
+}
+
+
+//
+// <unary_expr> ::= '*' IDENTIFIER
+//                | '&' IDENTIFIER
+//                | '+' [IDENTIFIER | INT_LITERAL | REAL_LITERAL]
+//                | '-' [IDENTIFIER | INT_LITERAL | REAL_LITERAL]
+//                | <element>
+//
+static bool parser_unary_expr(SYNTAX* syntax, struct UNARY_EXPR** unary_expr)
+{
+  UNARY_EXPR* unary = alloc<UNARY_EXPR>(syntax);
+  *unary_expr = unary;
+
+  int id = peek(syntax).token.id;
+
+  if (id == nuPy_ASTERISK || id == nuPy_AMPERSAND) {
+    unary->expr_type = (id == nuPy_ASTERISK) ? UNARY_PTR_DEREF : UNARY_ADDRESS_OF;
+    advance(syntax);
+
+    LEXEME identifier = peek(syntax);
+
+    if (!match(syntax, nuPy_IDENTIFIER, "identifier"))
+      return false;
+
+    unary->element = newElement(syntax, identifier);
+    return true;
+  }
+
+  if (id == nuPy_PLUS || id == nuPy_MINUS) {
+    unary->expr_type = (id == nuPy_PLUS) ? UNARY_PLUS : UNARY_MINUS;
+    advance(syntax);
+
+    int operand = peek(syntax).token.id;
+
+    if (operand == nuPy_IDENTIFIER || operand == nuPy_INT_LITERAL || operand == nuPy_REAL_LITERAL) {
+      unary->element = newElement(syntax, peek(syntax));
+      advance(syntax);
+      return true;
+    }
+
+    return errorMsg(syntax, "identifier or numeric literal", peek(syntax));
+  }
+
+  unary->expr_type = UNARY_ELEMENT;
+
+  return parser_element(syntax, &unary->element);
+}
+
+
+//
+// <expr> ::= <unary_expr> [<op> <unary_expr>]
+//
+static bool parser_expr(SYNTAX* syntax, struct EXPR** result)
+{
+  EXPR* expr = alloc<EXPR>(syntax);
+  *result = expr;
+
+  expr->isBinaryExpr = false;
+  expr->operator_type = OPERATOR_NO_OP;
+  expr->rhs = NULL;
+
+  if (!parser_unary_expr(syntax, &expr->lhs))
+    return false;
+
+  if (operatorType(syntax) == OPERATOR_NO_OP)
+    return true;
+
+  expr->isBinaryExpr = true;
+
+  if (!parser_op(syntax, &expr->operator_type))
+    return false;
+
+  return parser_unary_expr(syntax, &expr->rhs);
+}
+
+
+//
+// <function_call> ::= IDENTIFIER '(' [<element>] ')'
+//
+static bool parser_function_call(SYNTAX* syntax, char** function_name, struct ELEMENT** parameter)
+{
+  LEXEME name = peek(syntax);
+
+  if (!match(syntax, nuPy_IDENTIFIER, "identifier"))
+    return false;
+
+  if (!match(syntax, nuPy_LEFT_PAREN, "("))
+    return false;
+
+  *function_name = copy_value(syntax, name);
+  *parameter = NULL;
+
+  if (isElement(syntax)) {
+    *parameter = newElement(syntax, peek(syntax));
+    advance(syntax);
+  }
+
+  return match(syntax, nuPy_RIGHT_PAREN, ")");
+}
+
+
+//
+// <value> ::= <function_call> | <expr>
+//
+static bool parser_value(SYNTAX* syntax, struct VALUE** result)
+{
+  VALUE* value = alloc<VALUE>(syntax);
+  *result = value;
+
+  if (peek(syntax).token.id == nuPy_IDENTIFIER && peek2(syntax).token.id == nuPy_LEFT_PAREN) {
+    FUNCTION_CALL* call = alloc<FUNCTION_CALL>(syntax);
+
+    value->value_type = VALUE_FUNCTION_CALL;
+    value->types.function_call = call;
+
+    return parser_function_call(syntax, &call->function_name, &call->parameter);
+  }
+
+  value->value_type = VALUE_EXPR;
+
+  return parser_expr(syntax, &value->types.expr);
+}
+
+
+//
+// newStmt
+//
+// A stmt of the given type, starting on the given line, linked in
+// where *link points.
+//
+static struct STMT* newStmt(SYNTAX* syntax, struct STMT** link, int stmt_type, int line)
+{
+  STMT* stmt = alloc<STMT>(syntax);
+
+  stmt->stmt_type = stmt_type;
+  stmt->line = line;
+
+  *link = stmt;
+  return stmt;
+}
+
+
+static bool parser_stmts(SYNTAX* syntax, struct STMT*** link);
+
+//
+// <body> ::= '{' EOLN <stmts> '}' EOLN
+//
+// Links the body's stmts in where **link points, and leaves *link
+// pointing to the next_stmt field of the last one.
+//
+static bool parser_body(SYNTAX* syntax, struct STMT*** link)
+{
+  return match(syntax, nuPy_LEFT_BRACE, "{")
+    && match(syntax, nuPy_EOLN, "EOLN")
+    && parser_stmts(syntax, link)
+    && match(syntax, nuPy_RIGHT_BRACE, "}")
+    && match(syntax, nuPy_EOLN, "EOLN");
+}
+
+
+//
+// <else> ::= elif <expr> ':' EOLN <body> [<else>]
+//          | else ':' EOLN <body>
+//
+// (if statements aren't part of the graph yet, so what this builds
+// is never linked in.)
+//
+static bool parser_else(SYNTAX* syntax)
+{
+  EXPR* condition;
+  STMT* body = NULL;
+  STMT** link = &body;
+
+  while (true)
+  {
+    int id = peek(syntax).token.id;
+
+    if (id == nuPy_KEYW_ELIF) {
+      advance(syntax);
+
+      if (!parser_expr(syntax, &condition) ||
+          !match(syntax, nuPy_COLON, ":") ||
+          !match(syntax, nuPy_EOLN, "EOLN") ||
+          !parser_body(syntax, &link))
+        return false;
+
+      id = peek(syntax).token.id;
+
+      if (id != nuPy_KEYW_ELIF && id != nuPy_KEYW_ELSE)
+        return true;
+    }
+    else if (id == nuPy_KEYW_ELSE) {
+      advance(syntax);
+
+      return match(syntax, nuPy_COLON, ":")
+        && match(syntax, nuPy_EOLN, "EOLN")
+        && parser_body(syntax, &link);
+    }
+    else
+      return errorMsg(syntax, "elif or else", peek(syntax));
+  }
+}
+
+
+//
+// <call_stmt> ::= <function_call> EOLN
+//
+static bool parser_call_stmt(SYNTAX* syntax, struct STMT*** link)
+{
+  STMT* stmt = newStmt(syntax, *link, STMT_FUNCTION_CALL, peek(syntax).token.line);
+  struct STMT_FUNCTION_CALL* call = alloc<struct STMT_FUNCTION_CALL>(syntax);
+
+  stmt->types.function_call = call;
+  call->next_stmt = NULL;
+  *link = &call->next_stmt;
+
+  return parser_function_call(syntax, &call->function_name, &call->parameter)
+    && match(syntax, nuPy_EOLN, "EOLN");
+}
+
+
+//
+// <assignment> ::= ['*'] IDENTIFIER '=' <value> EOLN
+//
+static bool parser_assignment(SYNTAX* syntax, struct STMT*** link)
+{
+  bool isPtrDeref = false;
+
+  if (peek(syntax).token.id == nuPy_ASTERISK) {
+    isPtrDeref = true;
+    advance(syntax);
+  }
+
+  LEXEME name = peek(syntax);
+
+  if (!match(syntax, nuPy_IDENTIFIER, "identifier") ||
+      !match(syntax, nuPy_EQUAL, "="))
+    return false;
+
+  STMT* stmt = newStmt(syntax, *link, STMT_ASSIGNMENT, name.token.line);
+  struct STMT_ASSIGNMENT* assignment = alloc<struct STMT_ASSIGNMENT>(syntax);
+
+  stmt->types.assignment = assignment;
+  assignment->var_name = copy_value(syntax, name);
+  assignment->isPtrDeref = isPtrDeref;
+  assignment->next_stmt = NULL;
+  *link = &assignment->next_stmt;
+
+  return parser_value(syntax, &assignment->rhs)
+    && match(syntax, nuPy_EOLN, "EOLN");
+}
+
+
+//
+// <if_then_else> ::= if <expr> ':' EOLN <body> [<else>]
+//
+static bool parser_if_then_else(SYNTAX* syntax)
+{
+  unsupported(syntax, "if statements are not yet supported (programgraph_build)");
+
+  EXPR* condition;
+  STMT* body = NULL;
+  STMT** link = &body;
+
+  if (!match(syntax, nuPy_KEYW_IF, "if") ||
+      !parser_expr(syntax, &condition) ||
+      !match(syntax, nuPy_COLON, ":") ||
+      !match(syntax, nuPy_EOLN, "EOLN") ||
+      !parser_body(syntax, &link))
+    return false;
+
+  int id = peek(syntax).token.id;
+
+  if (id == nuPy_KEYW_ELIF || id == nuPy_KEYW_ELSE)
+    return parser_else(syntax);
+
+  return true;
+}
+
+
+//
+// <while_loop> ::= while <expr> ':' EOLN <body>
+//
+static bool parser_while_loop(SYNTAX* syntax, struct STMT*** link)
+{
+  if (!match(syntax, nuPy_KEYW_WHILE, "while"))
+    return false;
+
+  //
+  // like programgraph_build(), the loop's line is that of the token
+  // after "while":
+  //
+  STMT* stmt = newStmt(syntax, *link, STMT_WHILE_LOOP, peek(syntax).token.line);
+  struct STMT_WHILE_LOOP* loop = alloc<struct STMT_WHILE_LOOP>(syntax);
+
+  stmt->types.while_loop = loop;
+  loop->loop_body = NULL;
+  loop->next_stmt = NULL;
+  *link = &loop->next_stmt;
+
+  STMT** body = &loop->loop_body;
+
+  if (!parser_expr(syntax, &loop->condition) ||
+      !match(syntax, nuPy_COLON, ":") ||
+      !match(syntax, nuPy_EOLN, "EOLN") ||
+      !parser_body(syntax, &body))
+    return false;
+
+  //
+  // the end of the body goes back to the loop; a body of nothing but
+  // empty stmts leaves the loop nothing to go to:
+  //
+  if (loop->loop_body == NULL)
+    unsupported(syntax, "while loops with an empty body are not supported (programgraph_build)");
+  else
+    *body = stmt;
+
+  return true;
+}
+
+
+//
+// startOfStmt
+//
+// Can the next token start a statement?
+//
+static bool startOfStmt(SYNTAX* syntax)
+{
+  switch (peek(syntax).token.id)
+  {
+    case nuPy_EOLN:
+    case nuPy_ASTERISK:
+    case nuPy_IDENTIFIER:
+    case nuPy_KEYW_IF:
+    case nuPy_KEYW_PASS:
+    case nuPy_KEYW_WHILE:
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+
+//
+// <stmt> ::= <call_stmt> | <assignment> | <if_then_else>
+//          | <while_loop> | pass EOLN | EOLN
+//
+// Links the stmt in where **link points (an empty stmt isn't part of
+// the graph), and leaves *link pointing to its next_stmt field.
+//
+static bool parser_stmt(SYNTAX* syntax, struct STMT*** link)
+{
+  if (!startOfStmt(syntax))
+    return errorMsg(syntax, "start of a statement", peek(syntax));
+
+  const LEXEME& next = peek(syntax);
+
+  switch (next.token.id)
+  {
+    case nuPy_IDENTIFIER:
+      if (peek2(syntax).token.id == nuPy_EQUAL)
+        return parser_assignment(syntax, link);
+      if (peek2(syntax).token.id == nuPy_LEFT_PAREN)
+        return parser_call_stmt(syntax, link);
+      return errorMsg(syntax, "assignment or function call", next);
+
+    case nuPy_ASTERISK:
+      return parser_assignment(syntax, link);
+
+    case nuPy_KEYW_IF:
+      return parser_if_then_else(syntax);
+
+    case nuPy_KEYW_WHILE:
+      return parser_while_loop(syntax, link);
+
+    case nuPy_KEYW_PASS: {
+      STMT* stmt = newStmt(syntax, *link, STMT_PASS, next.token.line);
+      struct STMT_PASS* pass = alloc<struct STMT_PASS>(syntax);
+
+      stmt->types.pass = pass;
+      pass->next_stmt = NULL;
+      *link = &pass->next_stmt;
+
+      advance(syntax);
+      return match(syntax, nuPy_EOLN, "EOLN");
+    }
+
+    default:  // nuPy_EOLN, an empty stmt
+      return match(syntax, nuPy_EOLN, "EOLN");
+  }
+}
+
+
+//
+// <stmts> ::= <stmt> [<stmts>]
+//
+static bool parser_stmts(SYNTAX* syntax, struct STMT*** link)
+{
+  do {
+    if (!parser_stmt(syntax, link))
+      return false;
+  } while (startOfStmt(syntax));
+
+  return true;
+}
+
+
+//
+// <program> ::= <stmts> EOS
+//
+static bool parser_program(SYNTAX* syntax)
+{
+  STMT** link = &syntax->graph->program;
+
+  return parser_stmts(syntax, &link)
+    && match(syntax, nuPy_EOS, "$");
+}
+
+
+//
+// syntax_parse
+//
+struct PROGRAM_GRAPH* syntax_parse(const char* text, size_t length)
+{
+  SYNTAX syntax;
+  syntax.graph = graph_create();
+
+  lexer_init(&syntax.lexer, text, length);
+  scan(&syntax, &syntax.window[0]);
+  scan(&syntax, &syntax.window[1]);
+
+  if (!parser_program(&syntax)) {
+    graph_destroy(syntax.graph);
+    return NULL;
+  }
+
+  return syntax.graph;
+}
@@ -0,0 +1,33 @@
+/*syntax.h*/
+
+//
+// Front end for a nuPython program held in memory: checks the
+// program's syntax and builds its program graph in the same pass.
+// The program is scanned with the lexer a token at a time and checked
+// against the same BNF rules as parser_parse(), with the same error
+// messages; as each rule is matched, it builds the graph nodes that
+// programgraph_build() would build from the rule's tokens. No list
+// of the program's tokens is ever made.
+//
+
+#pragma once
+
+#include <stddef.h>
+
+#include "graph.h"
+
+
+//
+// Public functions:
+//
+
+//
+// syntax_parse
+//
+// Checks the syntax of the nuPython program in the length characters
+// at text. Returns NULL if a syntax error was found, after outputting
+// an error message. Otherwise returns the program graph, which the
+// caller frees with graph_destroy(); it doesn't refer to text. Call
+// graph_check() before using the graph.
+//
+struct PROGRAM_GRAPH* syntax_parse(const char* text, size_t length);
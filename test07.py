@@ -0,0 +1,52 @@
+## test07.py ##
+#
+# the VM engine: ints, reals, strings and booleans through every
+# operator, strings long enough to be ropes, int() and float() of
+# input, and nested loops. The output must be the same with -vm as
+# without it:
+#
+#     ./a.out -batch test07.txt -vm test07.py
+#     ./a.out -batch test07.txt test07.py
+#
+s = input('Enter an integer> ')
+n = int(s)
+s = input('Enter a real> ')
+r = float(s)
+
+i = 0
+total = 0
+ratio = 0.0
+text = "a"
+while i < n:
+{
+    j = 0
+    while j <= i:
+    {
+        product = i * j
+        total = total + product
+        j = j + 1
+    }
+    half = r / 2
+    ratio = ratio + half
+    text = text + text
+    i = i + 1
+}
+
+print(total)
+print(ratio)
+print(text)
+square = total ** 2
+rest = square % 7
+print(rest)
+difference = r - total
+print(difference)
+same = text == "a"
+print(same)
+different = text != 'aa'
+print(different)
+big = total >= 10
+print(big)
+smaller = ratio < r
+print(smaller)
+both = "first " + "second"
+print(both)
@@ -0,0 +1,42 @@
+## test08.py ##
+#
+# the optimizer: constants to fold, copies to propagate and stores
+# that are overwritten before they're read, inside and outside a
+# loop. With -O the run goes through the optimized program graph,
+# and the output and memory must be the same as without it:
+#
+#     ./a.out -batch test08.txt -O test08.py
+#     ./a.out -batch test08.txt test08.py
+#
+width = 8
+height = 5
+area = width * height
+copy = area
+scale = 2.5
+scaled = copy * scale
+
+label = "area"
+name = label
+label = name + "s"
+
+unused = 99
+unused = area - 1
+
+i = 0
+sum = 0
+step = width
+while i < height:
+{
+    last = i
+    sum = sum + step
+    offset = 3 + 4
+    sum = sum + offset
+    i = i + 1
+}
+
+print(area)
+print(scaled)
+print(label)
+print(unused)
+print(sum)
+print(last)
@@ -0,0 +1,22 @@
+## test09.py ##
+#
+# watches: the run stops right after any statement that changes a
+# watched variable, including its first assignment, and rw takes the
+# watch off again:
+#
+#     ./a.out -batch test09.txt test09.py
+#     ./a.out -batch test09.txt -vm test09.py
+#
+i = 0
+count = 0
+other = 0
+while i < 6:
+{
+    other = other + 1
+    remainder = i % 2
+    even = remainder == 0
+    count = count + remainder
+    i = i + 1
+}
+print(count)
+print(other)
@@ -0,0 +1,22 @@
+## test10.py ##
+#
+# running backwards: with the journal on, bs undoes the last
+# statement run, putting back the values it overwrote (or removing
+# a variable it created), and rr undoes statements until the
+# previous breakpoint. Without the journal neither has any history:
+#
+#     ./a.out -batch test10.txt test10.py
+#     ./a.out -batch test10.txt -vm test10.py
+#
+x = 1
+s = "start"
+n = 0
+while n < 4:
+{
+    x = x * 3
+    s = s + "!"
+    n = n + 1
+}
+y = x + 100
+print(y)
+print(s)
@@ -0,0 +1,22 @@
+## test11.py ##
+#
+# snapshots: save writes memory and the current line to a file, and
+# load goes back to them, here after the program has run to the end.
+# A file that isn't a snapshot is refused:
+#
+#     ./a.out -batch test11.txt test11.py
+#     ./a.out -batch test11.txt -vm test11.py
+#
+total = 0
+word = "x"
+k = 1
+while k <= 5:
+{
+    total = total + k
+    word = word + "y"
+    k = k + 1
+}
+average = total / 5
+print(total)
+print(average)
+print(word)
@@ -0,0 +1,23 @@
+## test12.py ##
+#
+# conditional breakpoints: "b n if expr" only stops at line n when
+# expr is true there, "b n after k" ignores the first k times line n
+# is reached, and the two combine. lb lists them with their
+# conditions; a condition that can't be evaluated is refused when the
+# breakpoint is set:
+#
+#     ./a.out -batch test12.txt test12.py
+#     ./a.out -batch test12.txt -vm test12.py
+#
+i = 0
+squares = 0
+name = "n"
+while i < 10:
+{
+    square = i * i
+    squares = squares + square
+    name = name + "i"
+    i = i + 1
+}
+print(squares)
+print(name)
@@ -0,0 +1,1477 @@
+/*vm.cpp*/
+
+//
+// Bytecode compiler and virtual machine for nuPython. See vm.h.
+//
+// Each statement compiles to an OP_STMT marker followed by the
+// instructions for that statement. Expressions are evaluated into a
+// small register file (an expression is at most "lhs op rhs", so two
+// registers are enough). Variables are compiled to slots; a slot
+// caches the variable's RAM address once the variable exists, and
+// RAM addresses never change, so reads and writes go straight to the
+// cell.
+//
+// Strings are immutable values (see rope.h): a string shorter than
+// VM_SMALL_STR characters is stored inline in the value itself, a
+// longer one is a reference-counted rope, so concatenating never
+// copies a long string, and passing one around only bumps a count.
+// Within one run of the VM, strings stored to variables are kept in
+// a per-slot cache rather than written to RAM, which would copy
+// them; the cache is written back to RAM whenever the VM stops, so
+// between runs RAM always holds every variable's value.
+//
+// Binary operations quicken: an OP_BINARY instruction notes the
+// operand types it sees the first time it runs and rewrites itself
+// into an instruction specialized for them (int + int, real < real,
+// ...), which only checks that the types are still the same. If they
+// aren't, the instruction reverts to OP_BINARY_GENERIC for good.
+// Where the type inference pass (see infer.h) proved the operand
+// types, the compiler emits the specialized instruction right away,
+// in a form that doesn't check them at all.
+//
+// The semantics follow execute() exactly, including its error
+// messages, since both engines must produce the same output. The one
+// exceptions are what execute() can't evaluate: it outputs "invalid
+// operand types" for "in" whatever the operands, while the VM
+// evaluates it on two strings, as a substring search (see strops.h);
+// and execute() aborts on unary + and -, which the VM evaluates on
+// ints and reals. The VM outputs "invalid operand types" for them on
+// anything else.
+//
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <map>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+#include "vm.h"
+#include "infer.h"
+#include "journal.h"
+#include "rope.h"
+#include "strops.h"
+
+using namespace std;
+
+
+//
+// Use computed goto for dispatch where the compiler supports it,
+// otherwise fall back to a switch:
+//
+#if defined(__GNUC__)
+#define VM_COMPUTED_GOTO 1
+#else
+#define VM_COMPUTED_GOTO 0
+#endif
+
+
+enum VM_OPCODES
+{
+  OP_STMT = 0,       // start of statement a, which is on line b
+  OP_LOAD_VAR,       // r[dst] = value of variable in slot a
+  OP_LOAD_CONST,     // r[dst] = constant a
+  OP_BINARY,         // r[dst] = r[a] <oper> r[b]
+  OP_STORE,          // variable in slot dst = r[a]
+  OP_PRINT,          // print(r[a])
+  OP_PRINT_NEWLINE,  // print()
+  OP_INPUT,          // r[dst] = input(constant a)
+  OP_INT,            // r[dst] = int(variable in slot a)
+  OP_FLOAT,          // r[dst] = float(variable in slot a)
+  OP_JUMP_FALSE,     // if r[a] is false, goto b
+  OP_JUMP,           // goto a
+  OP_FAIL,           // output message a, stop with an error
+  OP_HALT,           // end of program
+  OP_CONDITION,      // end of a breakpoint condition: stop if r[0] is true
+  OP_STORE_WATCHED,  // OP_STORE to a watched variable: stop after this statement
+  OP_UNARY,          // r[dst] = <oper> r[dst], oper UNARY_PLUS or UNARY_MINUS
+
+  //
+  // OP_BINARY quickened for the operand types it saw; each checks the
+  // types and falls back to OP_BINARY_GENERIC if they changed. All
+  // need dst == a.
+  //
+  OP_BINARY_GENERIC, // OP_BINARY that never quickens again
+  OP_ADD_II,         // int + int
+  OP_SUB_II,         // int - int
+  OP_MUL_II,         // int * int
+  OP_EQ_II,          // int == int
+  OP_NE_II,          // int != int
+  OP_LT_II,          // int < int
+  OP_LTE_II,         // int <= int
+  OP_GT_II,          // int > int
+  OP_GTE_II,         // int >= int
+  OP_BINARY_II,      // int <oper> int, any other oper
+  OP_BINARY_RR,      // real <oper> real
+  OP_BINARY_SS,      // str <oper> str
+
+  //
+  // The quickened forms above, in the same order, for operand types
+  // proven by type inference: no check. (OP_X_PROVEN - VM_PROVEN is
+  // OP_X.)
+  //
+  OP_ADD_II_PROVEN,
+  OP_SUB_II_PROVEN,
+  OP_MUL_II_PROVEN,
+  OP_EQ_II_PROVEN,
+  OP_NE_II_PROVEN,
+  OP_LT_II_PROVEN,
+  OP_LTE_II_PROVEN,
+  OP_GT_II_PROVEN,
+  OP_GTE_II_PROVEN,
+  OP_BINARY_II_PROVEN,
+  OP_BINARY_RR_PROVEN,
+  OP_BINARY_SS_PROVEN
+};
+
+#define VM_PROVEN (OP_ADD_II_PROVEN - OP_ADD_II)
+
+struct VM_INSTR
+{
+  unsigned char opcode;  // enum VM_OPCODES
+  unsigned char oper;    // enum OPERATORS, for OP_BINARY and its quickened forms
+  int dst;
+  int a;
+  int b;
+};
+
+#define VM_SMALL_STR 16  // strings shorter than this are stored inline
+
+//
+// Same as a RAM_VALUE, except for how a string is held:
+//
+struct VM_VALUE
+{
+  int value_type;  // enum RAM_VALUE_TYPES
+  int small;       // RAM_TYPE_STR: 1 + length if in types.chars, 0 if in types.rope
+
+  union
+  {
+    int    i;      // INT, PTR, BOOLEAN
+    double d;      // REAL
+    ROPE*  rope;   // STR, VM_SMALL_STR characters or longer
+    char   chars[VM_SMALL_STR];  // STR, shorter
+  } types;
+};
+
+enum VM_SLOT_STATES
+{
+  SLOT_UNCACHED = 0,  // the variable's value is in RAM
+  SLOT_CLEAN,         // slot_value holds the string in RAM
+  SLOT_DIRTY          // slot_value holds a string not written to RAM yet
+};
+
+//
+// a breakpoint condition, copied so it can be compiled again: the
+// strings of its elements belong to it:
+//
+struct VM_CONDITION
+{
+  EXPR       expr;
+  UNARY_EXPR lhs;
+  UNARY_EXPR rhs;
+  ELEMENT    lhs_element;
+  ELEMENT    rhs_element;
+};
+
+struct VM_PROGRAM
+{
+  vector<VM_INSTR> code;
+
+  vector<STMT*> stmts;                  // statement index -> statement
+  vector<int>   stmt_pc;                // statement index -> pc of its OP_STMT
+  unordered_map<STMT*, int> stmt_index; // statement -> statement index
+  int next_index = -1;                  // index of the stmt vm_step() returned last (skips the lookup)
+
+  vector<VM_VALUE> constants;           // decoded literals
+  vector<string>    messages;           // error messages for OP_FAIL
+
+  vector<char*> slot_names;             // slot -> variable name (borrowed from the graph)
+  vector<int>   slot_addr;              // slot -> RAM address, -1 until known
+  unordered_map<string, int> slots;     // variable name -> slot
+
+  vector<VM_VALUE> slot_value;          // slot -> cached string, during a run
+  vector<char>     slot_state;          // slot -> enum VM_SLOT_STATES
+  vector<int>      cached;              // slots not SLOT_UNCACHED
+
+  vector<char> scratch;                 // for building short strings
+
+  map<int, VM_CONDITION> conditions;    // line -> its breakpoint condition
+  vector<int>   line_conditions;        // line -> pc of its breakpoint condition, -1 if none
+  int    conditions_pc = 0;             // the conditions' code starts here, after OP_HALT,
+  size_t conditions_constants = 0;      //   and so do their constants
+  size_t conditions_messages = 0;       //   and messages
+  vector<char*> owned;                  // names of variables first seen in breakpoint conditions
+
+  JOURNAL* journal = NULL;              // undo journal to record into, if any
+
+  INFERENCE* inference = NULL;          // proven operand types, during vm_compile() only
+};
+
+#define VM_NUM_REGISTERS 2
+
+
+//
+// values:
+//
+static void vm_make_none(VM_VALUE* v)
+{
+  v->value_type = RAM_TYPE_NONE;
+  v->small = 0;
+}
+
+//
+// makes v a string holding a copy of the length characters at s:
+//
+static void vm_make_str(VM_VALUE* v, const char* s, size_t length)
+{
+  v->value_type = RAM_TYPE_STR;
+
+  if (length < VM_SMALL_STR) {
+    v->small = (int) length + 1;
+    memcpy(v->types.chars, s, length);
+    v->types.chars[length] = '\0';
+  }
+  else {
+    v->small = 0;
+    v->types.rope = rope_create(s, length);
+  }
+}
+
+static bool vm_is_rope(const VM_VALUE* v)
+{
+  return v->value_type == RAM_TYPE_STR && v->small == 0;
+}
+
+static void vm_release(VM_VALUE* v)
+{
+  if (vm_is_rope(v))
+    rope_unref(v->types.rope);
+}
+
+//
+// *dst = *src, releasing the value dst held:
+//
+static void vm_assign(VM_VALUE* dst, const VM_VALUE* src)
+{
+  if (vm_is_rope(src))
+    rope_ref(src->types.rope);
+
+  vm_release(dst);
+  *dst = *src;
+}
+
+static const char* vm_chars(VM_VALUE* v)
+{
+  return v->small ? v->types.chars : rope_chars(v->types.rope);
+}
+
+static size_t vm_length(const VM_VALUE* v)
+{
+  return v->small ? v->small - 1 : v->types.rope->length;
+}
+
+//
+// converts a value to and from RAM; a string in RAM is copied, a
+// string going to RAM is borrowed (RAM copies it when written):
+//
+static void vm_from_ram(VM_VALUE* v, const RAM_VALUE* value)
+{
+  if (value->value_type == RAM_TYPE_STR) {
+    vm_make_str(v, value->types.s, strlen(value->types.s));
+    return;
+  }
+
+  v->value_type = value->value_type;
+  v->small = 0;
+  memcpy(&v->types, &value->types, sizeof(value->types));
+}
+
+static RAM_VALUE vm_to_ram(VM_VALUE* v)
+{
+  RAM_VALUE value;
+  value.value_type = v->value_type;
+
+  if (v->value_type == RAM_TYPE_STR)
+    value.types.s = (char*) vm_chars(v);
+  else
+    memcpy(&value.types, &v->types, sizeof(value.types));
+
+  return value;
+}
+
+
+//
+// compiler:
+//
+static int vm_slot(VM_PROGRAM* vm, char* name)
+{
+  auto found = vm->slots.find(name);
+  if (found != vm->slots.end())
+    return found->second;
+
+  int slot = (int) vm->slot_names.size();
+  vm->slots[name] = slot;
+  vm->slot_names.push_back(name);
+  vm->slot_addr.push_back(-1);
+  vm->slot_value.push_back(VM_VALUE());
+  vm_make_none(&vm->slot_value.back());
+  vm->slot_state.push_back(SLOT_UNCACHED);
+  return slot;
+}
+
+static int vm_emit(VM_PROGRAM* vm, int opcode, int dst, int a, int b, int oper = OPERATOR_NO_OP)
+{
+  VM_INSTR instr;
+  instr.opcode = (unsigned char) opcode;
+  instr.oper = (unsigned char) oper;
+  instr.dst = dst;
+  instr.a = a;
+  instr.b = b;
+
+  vm->code.push_back(instr);
+  return (int) vm->code.size() - 1;
+}
+
+static int vm_message(VM_PROGRAM* vm, string msg)
+{
+  vm->messages.push_back(msg);
+  return (int) vm->messages.size() - 1;
+}
+
+//
+// Emits code to load the element into register r. Literals are
+// decoded here, once, exactly the way get_element_value() does.
+//
+static void vm_compile_element(VM_PROGRAM* vm, ELEMENT* element, int r)
+{
+  VM_VALUE value;
+  value.small = 0;
+
+  switch (element->element_type)
+  {
+  case ELEMENT_IDENTIFIER:
+    vm_emit(vm, OP_LOAD_VAR, r, vm_slot(vm, element->element_value), 0);
+    return;
+
+  case ELEMENT_INT_LITERAL:
+    value.value_type = RAM_TYPE_INT;
+    value.types.i = atoi(element->element_value);
+    break;
+
+  case ELEMENT_REAL_LITERAL:
+    value.value_type = RAM_TYPE_REAL;
+    value.types.d = atof(element->element_value);
+    break;
+
+  case ELEMENT_STR_LITERAL:
+    vm_make_str(&value, element->element_value, strlen(element->element_value));
+    break;
+
+  case ELEMENT_TRUE:
+  case ELEMENT_FALSE:
+    value.value_type = RAM_TYPE_BOOLEAN;
+    value.types.i = (element->element_type == ELEMENT_TRUE) ? 1 : 0;
+    break;
+
+  default:
+    vm_emit(vm, OP_FAIL, 0, vm_message(vm, "**EXECUTION ERROR: unexpected element type in get_element_value"), 0);
+    return;
+  }
+
+  vm->constants.push_back(value);
+  vm_emit(vm, OP_LOAD_CONST, r, (int) vm->constants.size() - 1, 0);
+}
+
+//
+// Emits code to load the value of the unary expression into register
+// r: an element, +element or -element. Returns false for pointers
+// (*p, &x), which the VM does not handle.
+//
+static bool vm_compile_unary(VM_PROGRAM* vm, UNARY_EXPR* unary, int r)
+{
+  if (unary->expr_type != UNARY_ELEMENT && unary->expr_type != UNARY_PLUS && unary->expr_type != UNARY_MINUS)
+    return false;
+
+  vm_compile_element(vm, unary->element, r);
+
+  if (unary->expr_type != UNARY_ELEMENT)
+    vm_emit(vm, OP_UNARY, r, 0, 0, unary->expr_type);
+
+  return true;
+}
+
+//
+// Emits code leaving the value of expr in register 0. Returns
+// false if the expression is not supported by the VM.
+//
+static int vm_quicken(int lhs_type, int oper, int rhs_type);
+
+static bool vm_compile_expr(VM_PROGRAM* vm, EXPR* expr)
+{
+  if (!vm_compile_unary(vm, expr->lhs, 0))
+    return false;
+
+  if (!expr->isBinaryExpr)
+    return true;
+
+  if (expr->operator_type == OPERATOR_IS || expr->operator_type == OPERATOR_NO_OP)
+    return false;
+  if (!vm_compile_unary(vm, expr->rhs, 1))
+    return false;
+
+  int opcode = OP_BINARY;
+  int lhs_type, rhs_type;
+
+  //
+  // inference doesn't look into unary operators, so infer_operands()
+  // only proves element operands:
+  //
+  if (vm->inference != NULL && infer_operands(vm->inference, expr, &lhs_type, &rhs_type)) {
+    int quickened = vm_quicken(lhs_type, expr->operator_type, rhs_type);
+
+    if (quickened != OP_BINARY_GENERIC)
+      opcode = quickened + VM_PROVEN;
+  }
+
+  vm_emit(vm, opcode, 0, 0, 1, expr->operator_type);
+  return true;
+}
+
+static bool vm_compile_function_call(VM_PROGRAM* vm, FUNCTION_CALL* call)
+{
+  ELEMENT* parameter = call->parameter;
+
+  if (parameter == NULL)
+    return false;
+
+  if (strcmp(call->function_name, "input") == 0) {
+    if (parameter->element_type != ELEMENT_STR_LITERAL)
+      return false;
+
+    VM_VALUE prompt;
+    vm_make_str(&prompt, parameter->element_value, strlen(parameter->element_value));
+    vm->constants.push_back(prompt);
+
+    vm_emit(vm, OP_INPUT, 0, (int) vm->constants.size() - 1, 0);
+  }
+  else if (strcmp(call->function_name, "int") == 0 || strcmp(call->function_name, "float") == 0) {
+    if (parameter->element_type != ELEMENT_IDENTIFIER)
+      return false;
+
+    int opcode = (strcmp(call->function_name, "int") == 0) ? OP_INT : OP_FLOAT;
+    vm_emit(vm, opcode, 0, vm_slot(vm, parameter->element_value), 0);
+  }
+  else {
+    string msg = "**EXECUTION ERROR: unsupported function (";
+    msg += call->function_name;
+    msg += ")";
+    vm_emit(vm, OP_FAIL, 0, vm_message(vm, msg), 0);
+  }
+
+  return true;
+}
+
+//
+// Compiles the statements from stmt up to (not including) stop,
+// which is NULL at the top level and the while loop itself for a
+// loop body. Returns false if any statement is not supported.
+//
+static bool vm_compile_body(VM_PROGRAM* vm, STMT* stmt, STMT* stop)
+{
+  while (stmt != stop && stmt != NULL)
+  {
+    int index = (int) vm->stmts.size();
+    vm->stmts.push_back(stmt);
+    vm->stmt_pc.push_back((int) vm->code.size());
+    vm->stmt_index[stmt] = index;
+
+    vm_emit(vm, OP_STMT, 0, index, stmt->line);
+
+    if (stmt->stmt_type == STMT_ASSIGNMENT) {
+      struct STMT_ASSIGNMENT* assign = stmt->types.assignment;
+
+      if (assign->isPtrDeref)
+        return false;
+
+      if (assign->rhs->value_type == VALUE_FUNCTION_CALL) {
+        if (!vm_compile_function_call(vm, assign->rhs->types.function_call))
+          return false;
+      }
+      else if (!vm_compile_expr(vm, assign->rhs->types.expr)) {
+        return false;
+      }
+
+      vm_emit(vm, OP_STORE, vm_slot(vm, assign->var_name), 0, 0);
+      stmt = assign->next_stmt;
+    }
+    else if (stmt->stmt_type == STMT_FUNCTION_CALL) {
+      struct STMT_FUNCTION_CALL* call = stmt->types.function_call;
+
+      if (strcmp(call->function_name, "print") != 0)
+        return false;
+
+      if (call->parameter == NULL) {
+        vm_emit(vm, OP_PRINT_NEWLINE, 0, 0, 0);
+      }
+      else {
+        vm_compile_element(vm, call->parameter, 0);
+        vm_emit(vm, OP_PRINT, 0, 0, 0);
+      }
+
+      stmt = call->next_stmt;
+    }
+    else if (stmt->stmt_type == STMT_WHILE_LOOP) {
+      struct STMT_WHILE_LOOP* loop = stmt->types.while_loop;
+
+      int top = vm->stmt_pc[index];
+
+      if (!vm_compile_expr(vm, loop->condition))
+        return false;
+
+      int exit_jump = vm_emit(vm, OP_JUMP_FALSE, 0, 0, 0);
+
+      if (!vm_compile_body(vm, loop->loop_body, stmt))
+        return false;
+
+      vm_emit(vm, OP_JUMP, 0, top, 0);
+      vm->code[exit_jump].b = (int) vm->code.size();
+
+      stmt = loop->next_stmt;
+    }
+    else if (stmt->stmt_type == STMT_PASS) {
+      stmt = stmt->types.pass->next_stmt;
+    }
+    else {
+      return false;  // if-then-else is not supported by the program graph yet
+    }
+  }
+
+  return true;
+}
+
+struct VM_PROGRAM* vm_compile(struct STMT* program, struct INFERENCE* inference)
+{
+  VM_PROGRAM* vm = new VM_PROGRAM;
+
+  vm->inference = inference;
+  bool compiled = vm_compile_body(vm, program, NULL);
+  vm->inference = NULL;
+
+  if (!compiled) {
+    delete vm;
+    return NULL;
+  }
+
+  vm_emit(vm, OP_HALT, 0, 0, 0);
+
+  vm->conditions_pc = (int) vm->code.size();
+  vm->conditions_constants = vm->constants.size();
+  vm->conditions_messages = vm->messages.size();
+  return vm;
+}
+
+static void vm_free_condition(VM_CONDITION& condition)
+{
+  free(condition.lhs_element.element_value);
+  if (condition.expr.isBinaryExpr)
+    free(condition.rhs_element.element_value);
+}
+
+void vm_destroy(struct VM_PROGRAM* vm)
+{
+  for (auto& entry : vm->conditions)
+    vm_free_condition(entry.second);
+
+  for (char* s : vm->owned)
+    free(s);
+
+  for (VM_VALUE& value : vm->constants)
+    vm_release(&value);
+
+  delete vm;
+}
+
+//
+// drops the code, constants and messages from the given point on:
+//
+static void vm_truncate(VM_PROGRAM* vm, int pc, size_t num_constants, size_t num_messages)
+{
+  vm->code.resize(pc);
+
+  for (size_t i = num_constants; i < vm->constants.size(); i++)
+    vm_release(&vm->constants[i]);
+  vm->constants.resize(num_constants);
+
+  vm->messages.resize(num_messages);
+}
+
+//
+// copies the element into the condition, with a string of its own.
+// A variable the program doesn't use gets its slot here, named by a
+// copy that lives as long as the VM, since a slot outlives the
+// condition that created it:
+//
+static void vm_copy_element(VM_PROGRAM* vm, ELEMENT* element, ELEMENT* copy)
+{
+  *copy = *element;
+
+  if (copy->element_value != NULL)
+    copy->element_value = strdup(copy->element_value);
+
+  if (copy->element_type == ELEMENT_IDENTIFIER && vm->slots.find(copy->element_value) == vm->slots.end()) {
+    char* name = strdup(copy->element_value);
+    vm->owned.push_back(name);
+    vm_slot(vm, name);
+  }
+}
+
+//
+// compiles every breakpoint condition again, each one as its own
+// little segment after the program, so removing or replacing one
+// leaves nothing behind. A condition the VM cannot evaluate is rolled
+// back and its line left without one (-1):
+//
+static void vm_compile_conditions(VM_PROGRAM* vm)
+{
+  vm_truncate(vm, vm->conditions_pc, vm->conditions_constants, vm->conditions_messages);
+  fill(vm->line_conditions.begin(), vm->line_conditions.end(), -1);
+
+  for (auto& entry : vm->conditions) {
+    int    pc = (int) vm->code.size();
+    size_t num_constants = vm->constants.size();
+    size_t num_messages = vm->messages.size();
+
+    if (!vm_compile_expr(vm, &entry.second.expr)) {
+      vm_truncate(vm, pc, num_constants, num_messages);
+      continue;
+    }
+
+    vm_emit(vm, OP_CONDITION, 0, 0, 0);
+    vm->line_conditions[entry.first] = pc;
+  }
+}
+
+bool vm_set_condition(struct VM_PROGRAM* vm, int line, struct EXPR* expr)
+{
+  if (line >= (int) vm->line_conditions.size())
+    vm->line_conditions.resize(line + 1, -1);
+
+  auto found = vm->conditions.find(line);
+  if (found != vm->conditions.end()) {
+    vm_free_condition(found->second);
+    vm->conditions.erase(found);
+  }
+
+  if (expr != NULL) {
+    VM_CONDITION& condition = vm->conditions[line];
+
+    condition.expr = *expr;
+    condition.lhs = *expr->lhs;
+    vm_copy_element(vm, expr->lhs->element, &condition.lhs_element);
+    condition.lhs.element = &condition.lhs_element;
+    condition.expr.lhs = &condition.lhs;
+
+    if (expr->isBinaryExpr) {
+      condition.rhs = *expr->rhs;
+      vm_copy_element(vm, expr->rhs->element, &condition.rhs_element);
+      condition.rhs.element = &condition.rhs_element;
+      condition.expr.rhs = &condition.rhs;
+    }
+  }
+
+  vm_compile_conditions(vm);
+
+  if (expr != NULL && vm->line_conditions[line] < 0) {
+    vm_free_condition(vm->conditions[line]);
+    vm->conditions.erase(line);
+    return false;
+  }
+
+  return true;
+}
+
+void vm_set_journal(struct VM_PROGRAM* vm, struct JOURNAL* journal)
+{
+  vm->journal = journal;
+}
+
+void vm_cell_removed(struct VM_PROGRAM* vm, int addr)
+{
+  for (int& slot_addr : vm->slot_addr) {
+    if (slot_addr == addr)
+      slot_addr = -1;
+  }
+}
+
+void vm_memory_reset(struct VM_PROGRAM* vm)
+{
+  for (int& slot_addr : vm->slot_addr)
+    slot_addr = -1;
+
+  //
+  // what was proven about the types of variables was for memory the
+  // program wrote itself; check them again:
+  //
+  for (VM_INSTR& instr : vm->code)
+    if (instr.opcode >= OP_ADD_II_PROVEN)
+      instr.opcode -= VM_PROVEN;
+}
+
+void vm_watch(struct VM_PROGRAM* vm, char* name, bool watched)
+{
+  auto found = vm->slots.find(name);
+  if (found == vm->slots.end())  // never assigned by the program:
+    return;
+
+  //
+  // swap the opcode of the stores to this variable, so stores to
+  // variables that are not watched cost nothing extra:
+  //
+  for (VM_INSTR& instr : vm->code) {
+    if ((instr.opcode == OP_STORE || instr.opcode == OP_STORE_WATCHED) && instr.dst == found->second)
+      instr.opcode = watched ? OP_STORE_WATCHED : OP_STORE;
+  }
+}
+
+
+//
+// execution helpers:
+//
+static bool starts_with_zero(const char* s)
+{
+  return s[0] == '0';
+}
+
+static char* vm_scratch(VM_PROGRAM* vm, size_t size)
+{
+  if (vm->scratch.size() < size)
+    vm->scratch.resize(size);
+
+  return vm->scratch.data();
+}
+
+//
+// Same as perform_int_operation: arithmetic yields an int,
+// comparisons a boolean.
+//
+static void vm_int_operation(VM_VALUE* r, int lhs, int oper, int rhs)
+{
+  r->value_type = RAM_TYPE_INT;
+
+  switch (oper)
+  {
+  case OPERATOR_PLUS:      r->types.i = lhs + rhs; return;
+  case OPERATOR_MINUS:     r->types.i = lhs - rhs; return;
+  case OPERATOR_ASTERISK:  r->types.i = lhs * rhs; return;
+  case OPERATOR_POWER:     r->types.i = (int) pow((double) lhs, (double) rhs); return;
+  case OPERATOR_MOD:       r->types.i = lhs % rhs; return;
+  case OPERATOR_DIV:       r->types.i = lhs / rhs; return;
+  default:
+    break;
+  }
+
+  r->value_type = RAM_TYPE_BOOLEAN;
+
+  switch (oper)
+  {
+  case OPERATOR_EQUAL:     r->types.i = (lhs == rhs); return;
+  case OPERATOR_NOT_EQUAL: r->types.i = (lhs != rhs); return;
+  case OPERATOR_LT:        r->types.i = (lhs < rhs);  return;
+  case OPERATOR_LTE:       r->types.i = (lhs <= rhs); return;
+  case OPERATOR_GT:        r->types.i = (lhs > rhs);  return;
+  default:                 r->types.i = (lhs >= rhs); return;
+  }
+}
+
+//
+// Same as perform_real_operation: arithmetic yields a real,
+// comparisons a boolean.
+//
+static void vm_real_operation(VM_VALUE* r, double lhs, int oper, double rhs)
+{
+  r->value_type = RAM_TYPE_REAL;
+
+  switch (oper)
+  {
+  case OPERATOR_PLUS:      r->types.d = lhs + rhs; return;
+  case OPERATOR_MINUS:     r->types.d = lhs - rhs; return;
+  case OPERATOR_ASTERISK:  r->types.d = lhs * rhs; return;
+  case OPERATOR_POWER:     r->types.d = pow(lhs, rhs); return;
+  case OPERATOR_MOD:       r->types.d = fmod(lhs, rhs); return;
+  case OPERATOR_DIV:       r->types.d = lhs / rhs; return;
+  default:
+    break;
+  }
+
+  r->value_type = RAM_TYPE_BOOLEAN;
+
+  switch (oper)
+  {
+  case OPERATOR_EQUAL:     r->types.i = (lhs == rhs); return;
+  case OPERATOR_NOT_EQUAL: r->types.i = (lhs != rhs); return;
+  case OPERATOR_LT:        r->types.i = (lhs < rhs);  return;
+  case OPERATOR_LTE:       r->types.i = (lhs <= rhs); return;
+  case OPERATOR_GT:        r->types.i = (lhs > rhs);  return;
+  default:                 r->types.i = (lhs >= rhs); return;
+  }
+}
+
+//
+// Same as perform_str_operation, except a concatenation involving a
+// long string makes a rope instead of copying both strings, and one
+// of two short strings is built in the scratch buffer. Comparisons
+// use the vectorized kernels (see strops.h) on the known lengths;
+// strings of different lengths are unequal without being flattened.
+// "lhs in rhs" is a substring search with strops_find(), which
+// execute() doesn't do (see the top of the file). Returns false for
+// an operator strings do not support.
+//
+static bool vm_str_operation(VM_PROGRAM* vm, VM_VALUE* r, VM_VALUE* lhs, int oper, VM_VALUE* rhs)
+{
+  if (oper == OPERATOR_PLUS) {
+    size_t len1 = vm_length(lhs);
+    size_t len2 = vm_length(rhs);
+
+    if (!lhs->small) {
+      r->value_type = RAM_TYPE_STR;
+      r->small = 0;
+      r->types.rope = rhs->small ? rope_append(lhs->types.rope, rhs->types.chars, len2)
+                                 : rope_concat(lhs->types.rope, rhs->types.rope);
+    }
+    else if (!rhs->small) {
+      ROPE* prefix = rope_create(lhs->types.chars, len1);
+
+      r->value_type = RAM_TYPE_STR;
+      r->small = 0;
+      r->types.rope = rope_concat(prefix, rhs->types.rope);
+
+      rope_unref(prefix);
+    }
+    else {
+      char* s = vm_scratch(vm, len1 + len2 + 1);
+
+      memcpy(s, lhs->types.chars, len1);
+      memcpy(s + len1, rhs->types.chars, len2);
+
+      vm_make_str(r, s, len1 + len2);
+    }
+
+    return true;
+  }
+
+  size_t len1 = vm_length(lhs);
+  size_t len2 = vm_length(rhs);
+
+  r->value_type = RAM_TYPE_BOOLEAN;
+
+  if (oper == OPERATOR_IN) {
+    r->types.i = strops_find(vm_chars(rhs), len2, vm_chars(lhs), len1) >= 0;
+    return true;
+  }
+
+  if (oper == OPERATOR_EQUAL || oper == OPERATOR_NOT_EQUAL) {
+    bool equal = (len1 == len2) && strops_equal(vm_chars(lhs), len1, vm_chars(rhs), len2);
+
+    r->types.i = (oper == OPERATOR_EQUAL) ? equal : !equal;
+    return true;
+  }
+
+  int cmp = strops_compare(vm_chars(lhs), len1, vm_chars(rhs), len2);
+
+  switch (oper)
+  {
+  case OPERATOR_LT:        r->types.i = (cmp < 0);  return true;
+  case OPERATOR_LTE:       r->types.i = (cmp <= 0); return true;
+  case OPERATOR_GT:        r->types.i = (cmp > 0);  return true;
+  case OPERATOR_GTE:       r->types.i = (cmp >= 0); return true;
+  default:
+    return false;
+  }
+}
+
+//
+// r = lhs <oper> rhs, following execute_binary_expression. Returns
+// false on a type error (message already output). r may be lhs or
+// rhs.
+//
+static bool vm_binary(VM_PROGRAM* vm, STMT* stmt, VM_VALUE* r, VM_VALUE* lhs, int oper, VM_VALUE* rhs)
+{
+  VM_VALUE result;
+  result.small = 0;
+
+  if (oper == OPERATOR_IN && (lhs->value_type != RAM_TYPE_STR || rhs->value_type != RAM_TYPE_STR)) {
+    printf("**SEMANTIC ERROR: invalid operand types (line %d)\n", stmt->line);
+    return false;
+  }
+
+  if (lhs->value_type == RAM_TYPE_INT && rhs->value_type == RAM_TYPE_INT)
+    vm_int_operation(&result, lhs->types.i, oper, rhs->types.i);
+  else if (lhs->value_type == RAM_TYPE_REAL && rhs->value_type == RAM_TYPE_REAL)
+    vm_real_operation(&result, lhs->types.d, oper, rhs->types.d);
+  else if (lhs->value_type == RAM_TYPE_INT && rhs->value_type == RAM_TYPE_REAL)
+    vm_real_operation(&result, (double) lhs->types.i, oper, rhs->types.d);
+  else if (lhs->value_type == RAM_TYPE_REAL && rhs->value_type == RAM_TYPE_INT)
+    vm_real_operation(&result, lhs->types.d, oper, (double) rhs->types.i);
+  else if (lhs->value_type != RAM_TYPE_STR || rhs->value_type != RAM_TYPE_STR ||
+           !vm_str_operation(vm, &result, lhs, oper, rhs)) {
+    printf("**SEMANTIC ERROR: invalid operand types (line %d)\n", stmt->line);
+    return false;
+  }
+
+  vm_release(r);
+  *r = result;
+  return true;
+}
+
+//
+// r = <oper> r for oper UNARY_PLUS or UNARY_MINUS, on an int or a
+// real. Returns false for any other type (message already output).
+//
+static bool vm_unary(STMT* stmt, VM_VALUE* r, int oper)
+{
+  if (r->value_type == RAM_TYPE_INT) {
+    if (oper == UNARY_MINUS)
+      r->types.i = -r->types.i;
+    return true;
+  }
+
+  if (r->value_type == RAM_TYPE_REAL) {
+    if (oper == UNARY_MINUS)
+      r->types.d = -r->types.d;
+    return true;
+  }
+
+  printf("**SEMANTIC ERROR: invalid operand types (line %d)\n", stmt->line);
+  return false;
+}
+
+//
+// Returns the opcode an OP_BINARY instruction whose operands had the
+// given types quickens to:
+//
+static int vm_quicken(int lhs_type, int oper, int rhs_type)
+{
+  if (oper == OPERATOR_IN)  // only on strings
+    return (lhs_type == RAM_TYPE_STR && rhs_type == RAM_TYPE_STR) ? OP_BINARY_SS : OP_BINARY_GENERIC;
+
+  if (lhs_type == RAM_TYPE_INT && rhs_type == RAM_TYPE_INT) {
+    switch (oper)
+    {
+    case OPERATOR_PLUS:      return OP_ADD_II;
+    case OPERATOR_MINUS:     return OP_SUB_II;
+    case OPERATOR_ASTERISK:  return OP_MUL_II;
+    case OPERATOR_EQUAL:     return OP_EQ_II;
+    case OPERATOR_NOT_EQUAL: return OP_NE_II;
+    case OPERATOR_LT:        return OP_LT_II;
+    case OPERATOR_LTE:       return OP_LTE_II;
+    case OPERATOR_GT:        return OP_GT_II;
+    case OPERATOR_GTE:       return OP_GTE_II;
+    default:                 return OP_BINARY_II;
+    }
+  }
+
+  if (lhs_type == RAM_TYPE_REAL && rhs_type == RAM_TYPE_REAL)
+    return OP_BINARY_RR;
+  if (lhs_type == RAM_TYPE_STR && rhs_type == RAM_TYPE_STR)
+    return OP_BINARY_SS;
+
+  return OP_BINARY_GENERIC;  // mixed types
+}
+
+//
+// Returns the address of the variable in the given slot, or -1
+// (after outputting an error message) if it is not defined yet.
+//
+static int vm_read_addr(VM_PROGRAM* vm, RAM* memory, STMT* stmt, int slot)
+{
+  int addr = vm->slot_addr[slot];
+
+  if (addr < 0) {
+    addr = ram_get_addr(memory, vm->slot_names[slot]);
+
+    if (addr < 0) {
+      printf("**SEMANTIC ERROR: name '%s' is not defined (line %d)\n", vm->slot_names[slot], stmt->line);
+      return -1;
+    }
+
+    vm->slot_addr[slot] = addr;
+  }
+
+  return addr;
+}
+
+//
+// Returns the value of the variable in the given slot, or NULL
+// (after outputting an error message) if it is not defined yet. A
+// string is copied out of RAM into the slot's cache, once per run.
+//
+static VM_VALUE* vm_load(VM_PROGRAM* vm, RAM* memory, STMT* stmt, int slot, VM_VALUE* r)
+{
+  if (vm->slot_state[slot] != SLOT_UNCACHED)
+    return &vm->slot_value[slot];
+
+  int addr = vm_read_addr(vm, memory, stmt, slot);
+  if (addr < 0)
+    return NULL;
+
+  const RAM_VALUE* value = ram_peek_by_addr(memory, addr);
+
+  if (value->value_type != RAM_TYPE_STR) {
+    vm_release(r);
+    vm_from_ram(r, value);
+    return r;
+  }
+
+  vm_from_ram(&vm->slot_value[slot], value);
+  vm->slot_state[slot] = SLOT_CLEAN;
+  vm->cached.push_back(slot);
+
+  return &vm->slot_value[slot];
+}
+
+static void vm_store(VM_PROGRAM* vm, RAM* memory, int slot, VM_VALUE* value)
+{
+  int addr = vm->slot_addr[slot];
+
+  if (addr < 0) {
+    addr = ram_get_addr(memory, vm->slot_names[slot]);
+
+    if (addr < 0) {
+      ram_write_cell_by_name(memory, vm_to_ram(value), vm->slot_names[slot]);
+      vm->slot_addr[slot] = ram_get_addr(memory, vm->slot_names[slot]);
+
+      if (vm->journal != NULL)
+        journal_new_cell(vm->journal, vm->slot_addr[slot]);
+      return;
+    }
+
+    vm->slot_addr[slot] = addr;
+  }
+
+  char* state = &vm->slot_state[slot];
+
+  if (vm->journal != NULL) {
+    VM_VALUE* old = &vm->slot_value[slot];
+
+    if (*state == SLOT_UNCACHED)
+      journal_old_value(vm->journal, addr, ram_peek_by_addr(memory, addr));
+    else if (vm_is_rope(old))
+      journal_old_string(vm->journal, addr, old->types.rope);
+    else {
+      RAM_VALUE old_value = vm_to_ram(old);
+      journal_old_value(vm->journal, addr, &old_value);
+    }
+  }
+
+  //
+  // a string goes to the cache rather than RAM, as does anything
+  // stored to a variable that is cached already:
+  //
+  if (*state == SLOT_UNCACHED && value->value_type != RAM_TYPE_STR) {
+    ram_write_cell_by_addr(memory, vm_to_ram(value), addr);
+    return;
+  }
+
+  if (*state == SLOT_UNCACHED)
+    vm->cached.push_back(slot);
+
+  vm_assign(&vm->slot_value[slot], value);
+  *state = SLOT_DIRTY;
+}
+
+//
+// Writes the values of the cached variables to RAM and empties the
+// cache and the registers; called whenever the VM stops.
+//
+static void vm_flush(VM_PROGRAM* vm, RAM* memory, VM_VALUE* r)
+{
+  for (int slot : vm->cached) {
+    VM_VALUE* value = &vm->slot_value[slot];
+
+    if (vm->slot_state[slot] == SLOT_DIRTY)
+      ram_write_cell_by_addr(memory, vm_to_ram(value), vm->slot_addr[slot]);
+
+    vm_release(value);
+    vm_make_none(value);
+    vm->slot_state[slot] = SLOT_UNCACHED;
+  }
+
+  vm->cached.clear();
+
+  for (int i = 0; i < VM_NUM_REGISTERS; i++)
+    vm_release(&r[i]);
+}
+
+//
+// the truth test execute() applies to a loop condition is on the
+// value's integer field, which for a string is part of a pointer --
+// never 0:
+//
+static bool vm_is_true(const VM_VALUE* v)
+{
+  return v->value_type == RAM_TYPE_STR || v->types.i != 0;
+}
+
+
+//
+// vm_run
+//
+// Executes from the given pc until budget statements have been
+// executed (budget < 0 => no limit), the next statement is on a
+// line flagged in stop_lines (the first statement is always
+// executed), or the program halts. *next_index is set to the index
+// of the statement that executes next, -1 if the program completed
+// or failed.
+//
+static struct ExecuteResult vm_run(VM_PROGRAM* vm, RAM* memory, int pc, long budget,
+                                   const unsigned char* stop_lines, int num_lines, int* next_index)
+{
+  VM_INSTR*  code = vm->code.data();
+  VM_INSTR*  ip = code + pc;
+  VM_VALUE   r[VM_NUM_REGISTERS];
+  STMT*      stmt = NULL;
+  VM_INSTR*  condition_stmt = NULL;  // OP_STMT whose breakpoint condition is being evaluated
+
+  struct ExecuteResult result;
+  result.Success = false;
+  result.LastStmt = NULL;
+
+  *next_index = -1;
+
+  for (int i = 0; i < VM_NUM_REGISTERS; i++)
+    vm_make_none(&r[i]);
+
+#if VM_COMPUTED_GOTO
+  static void* labels[] = {
+    &&L_OP_STMT, &&L_OP_LOAD_VAR, &&L_OP_LOAD_CONST, &&L_OP_BINARY, &&L_OP_STORE,
+    &&L_OP_PRINT, &&L_OP_PRINT_NEWLINE, &&L_OP_INPUT, &&L_OP_INT, &&L_OP_FLOAT,
+    &&L_OP_JUMP_FALSE, &&L_OP_JUMP, &&L_OP_FAIL, &&L_OP_HALT, &&L_OP_CONDITION,
+    &&L_OP_STORE_WATCHED, &&L_OP_UNARY, &&L_OP_BINARY_GENERIC, &&L_OP_ADD_II, &&L_OP_SUB_II, &&L_OP_MUL_II,
+    &&L_OP_EQ_II, &&L_OP_NE_II, &&L_OP_LT_II, &&L_OP_LTE_II, &&L_OP_GT_II, &&L_OP_GTE_II,
+    &&L_OP_BINARY_II, &&L_OP_BINARY_RR, &&L_OP_BINARY_SS, &&L_OP_ADD_II_PROVEN,
+    &&L_OP_SUB_II_PROVEN, &&L_OP_MUL_II_PROVEN, &&L_OP_EQ_II_PROVEN, &&L_OP_NE_II_PROVEN,
+    &&L_OP_LT_II_PROVEN, &&L_OP_LTE_II_PROVEN, &&L_OP_GT_II_PROVEN, &&L_OP_GTE_II_PROVEN,
+    &&L_OP_BINARY_II_PROVEN, &&L_OP_BINARY_RR_PROVEN, &&L_OP_BINARY_SS_PROVEN
+  };
+#define VM_DISPATCH()  goto *labels[ip->opcode]
+#define VM_CASE(op)    L_##op:
+#else
+#define VM_DISPATCH()  continue
+#define VM_CASE(op)    case op:
+#endif
+#define VM_NEXT()      { ip++; VM_DISPATCH(); }
+
+  for (;;)
+  {
+#if VM_COMPUTED_GOTO
+    VM_DISPATCH();
+#else
+    switch (ip->opcode)
+#endif
+    {
+    VM_CASE(OP_STMT)
+      if (stmt != NULL && (--budget == 0 || (ip->b < num_lines && stop_lines[ip->b]))) {
+        //
+        // a breakpoint with a condition only stops if the condition
+        // is true; evaluate it in the context of this statement:
+        //
+        if (budget != 0 && ip->b < (int) vm->line_conditions.size() && vm->line_conditions[ip->b] >= 0) {
+          condition_stmt = ip;
+          stmt = vm->stmts[ip->a];
+          ip = code + vm->line_conditions[ip->b];
+          VM_DISPATCH();
+        }
+        goto stopped;
+      }
+      stmt = vm->stmts[ip->a];
+      if (vm->journal != NULL)
+        journal_begin(vm->journal, ip->b);
+      VM_NEXT();
+
+    VM_CASE(OP_LOAD_VAR)
+    {
+      VM_VALUE* value = vm_load(vm, memory, stmt, ip->a, &r[ip->dst]);
+      if (value == NULL)
+        goto failed;
+      if (value != &r[ip->dst])
+        vm_assign(&r[ip->dst], value);
+      VM_NEXT();
+    }
+
+    VM_CASE(OP_LOAD_CONST)
+      vm_assign(&r[ip->dst], &vm->constants[ip->a]);
+      VM_NEXT();
+
+    VM_CASE(OP_BINARY)
+    {
+      int lhs_type = r[ip->a].value_type;
+      int rhs_type = r[ip->b].value_type;
+
+      if (!vm_binary(vm, stmt, &r[ip->dst], &r[ip->a], ip->oper, &r[ip->b]))
+        goto failed;
+
+      ip->opcode = (ip->dst == ip->a) ? vm_quicken(lhs_type, ip->oper, rhs_type) : OP_BINARY_GENERIC;
+      VM_NEXT();
+    }
+
+    VM_CASE(OP_BINARY_GENERIC)
+      if (!vm_binary(vm, stmt, &r[ip->dst], &r[ip->a], ip->oper, &r[ip->b]))
+        goto failed;
+      VM_NEXT();
+
+    //
+    // the quickened forms; r[a] is r[dst], and once it's known to be
+    // an int or real there is no string to release before it's
+    // overwritten. The proven forms start right after the check:
+    //
+#define VM_GUARD(type) \
+      if (r[ip->a].value_type != (type) || r[ip->b].value_type != (type)) { \
+        ip->opcode = OP_BINARY_GENERIC; \
+        VM_DISPATCH(); \
+      }
+#define VM_INT_CASE(op, result_type, expr) \
+    VM_CASE(op) \
+      VM_GUARD(RAM_TYPE_INT) \
+    VM_CASE(op##_PROVEN) \
+      r[ip->a].value_type = (result_type); \
+      r[ip->a].types.i = (expr); \
+      VM_NEXT();
+
+    VM_INT_CASE(OP_ADD_II, RAM_TYPE_INT,     r[ip->a].types.i + r[ip->b].types.i)
+    VM_INT_CASE(OP_SUB_II, RAM_TYPE_INT,     r[ip->a].types.i - r[ip->b].types.i)
+    VM_INT_CASE(OP_MUL_II, RAM_TYPE_INT,     r[ip->a].types.i * r[ip->b].types.i)
+    VM_INT_CASE(OP_EQ_II,  RAM_TYPE_BOOLEAN, r[ip->a].types.i == r[ip->b].types.i)
+    VM_INT_CASE(OP_NE_II,  RAM_TYPE_BOOLEAN, r[ip->a].types.i != r[ip->b].types.i)
+    VM_INT_CASE(OP_LT_II,  RAM_TYPE_BOOLEAN, r[ip->a].types.i < r[ip->b].types.i)
+    VM_INT_CASE(OP_LTE_II, RAM_TYPE_BOOLEAN, r[ip->a].types.i <= r[ip->b].types.i)
+    VM_INT_CASE(OP_GT_II,  RAM_TYPE_BOOLEAN, r[ip->a].types.i > r[ip->b].types.i)
+    VM_INT_CASE(OP_GTE_II, RAM_TYPE_BOOLEAN, r[ip->a].types.i >= r[ip->b].types.i)
+
+    VM_CASE(OP_BINARY_II)
+      VM_GUARD(RAM_TYPE_INT)
+    VM_CASE(OP_BINARY_II_PROVEN)
+      vm_int_operation(&r[ip->a], r[ip->a].types.i, ip->oper, r[ip->b].types.i);
+      VM_NEXT();
+
+    VM_CASE(OP_BINARY_RR)
+      VM_GUARD(RAM_TYPE_REAL)
+    VM_CASE(OP_BINARY_RR_PROVEN)
+      vm_real_operation(&r[ip->a], r[ip->a].types.d, ip->oper, r[ip->b].types.d);
+      VM_NEXT();
+
+    VM_CASE(OP_BINARY_SS)
+      VM_GUARD(RAM_TYPE_STR)
+    VM_CASE(OP_BINARY_SS_PROVEN)
+    {
+      VM_VALUE result;
+      if (!vm_str_operation(vm, &result, &r[ip->a], ip->oper, &r[ip->b])) {
+        ip->opcode = OP_BINARY_GENERIC;  // outputs the error
+        VM_DISPATCH();
+      }
+
+      vm_release(&r[ip->a]);
+      r[ip->a] = result;
+      VM_NEXT();
+    }
+
+#undef VM_INT_CASE
+#undef VM_GUARD
+
+    VM_CASE(OP_STORE)
+      vm_store(vm, memory, ip->dst, &r[ip->a]);
+      VM_NEXT();
+
+    VM_CASE(OP_STORE_WATCHED)
+      vm_store(vm, memory, ip->dst, &r[ip->a]);
+      if (stop_lines != NULL)  // vm_continue(): the next OP_STMT stops
+        budget = 1;
+      VM_NEXT();
+
+    VM_CASE(OP_UNARY)
+      if (!vm_unary(stmt, &r[ip->dst], ip->oper))
+        goto failed;
+      VM_NEXT();
+
+    VM_CASE(OP_PRINT)
+    {
+      VM_VALUE* value = &r[ip->a];
+
+      if (value->value_type == RAM_TYPE_INT)
+        printf("%d\n", value->types.i);
+      else if (value->value_type == RAM_TYPE_REAL)
+        printf("%lf\n", value->types.d);
+      else if (value->value_type == RAM_TYPE_STR)
+        puts(vm_chars(value));
+      else if (value->value_type == RAM_TYPE_BOOLEAN)
+        puts(value->types.i ? "True" : "False");
+      else {
+        printf("**EXECUTION ERROR: unexpected element type in execute_function_call");
+        goto failed;
+      }
+      VM_NEXT();
+    }
+
+    VM_CASE(OP_PRINT_NEWLINE)
+      putchar('\n');
+      VM_NEXT();
+
+    VM_CASE(OP_INPUT)
+    {
+      char line[256] = "";
+
+      printf("%s", vm_chars(&vm->constants[ip->a]));
+      cin >> setw(sizeof(line)) >> line;
+      line[strcspn(line, "\r\n")] = '\0';
+
+      vm_release(&r[ip->dst]);
+      vm_make_str(&r[ip->dst], line, strlen(line));
+      VM_NEXT();
+    }
+
+    VM_CASE(OP_INT)
+    VM_CASE(OP_FLOAT)
+    {
+      VM_VALUE* value = vm_load(vm, memory, stmt, ip->a, &r[ip->dst]);
+      if (value == NULL)
+        goto failed;
+
+      if (value->value_type != RAM_TYPE_STR) {
+        printf("**SEMANTIC ERROR: invalid operand types (line %d)\n", stmt->line);
+        goto failed;
+      }
+
+      const char* s = vm_chars(value);
+      vm_release(&r[ip->dst]);
+
+      if (ip->opcode == OP_INT) {
+        r[ip->dst].value_type = RAM_TYPE_INT;
+        r[ip->dst].types.i = atoi(s);
+
+        if (r[ip->dst].types.i == 0 && !starts_with_zero(s)) {
+          printf("**SEMANTIC ERROR: invalid string for int() (line %d)\n", stmt->line);
+          goto failed;
+        }
+      }
+      else {
+        r[ip->dst].value_type = RAM_TYPE_REAL;
+        r[ip->dst].types.d = atof(s);
+
+        if (r[ip->dst].types.d == 0.0 && !starts_with_zero(s)) {
+          printf("**SEMANTIC ERROR: invalid string for float() (line %d)\n", stmt->line);
+          goto failed;
+        }
+      }
+      VM_NEXT();
+    }
+
+    VM_CASE(OP_JUMP_FALSE)
+      //
+      // like execute(), a loop condition is tested via its integer field:
+      //
+      if (!vm_is_true(&r[ip->a]))
+        ip = code + ip->b;
+      else
+        ip++;
+      VM_DISPATCH();
+
+    VM_CASE(OP_JUMP)
+      ip = code + ip->a;
+      VM_DISPATCH();
+
+    VM_CASE(OP_FAIL)
+      printf("%s", vm->messages[ip->a].c_str());
+      goto failed;
+
+    VM_CASE(OP_HALT)
+      vm_flush(vm, memory, r);
+      result.Success = true;
+      result.LastStmt = stmt;
+      return result;
+
+    VM_CASE(OP_CONDITION)
+      ip = condition_stmt;
+      condition_stmt = NULL;
+
+      //
+      // same truth test as a loop condition:
+      //
+      if (vm_is_true(&r[0]))
+        goto stopped;
+
+      stmt = vm->stmts[ip->a];
+      if (vm->journal != NULL)
+        journal_begin(vm->journal, ip->b);
+      VM_NEXT();
+    }
+  }
+
+#undef VM_DISPATCH
+#undef VM_CASE
+#undef VM_NEXT
+
+stopped:
+  vm_flush(vm, memory, r);
+  *next_index = ip->a;
+  result.Success = true;
+  result.LastStmt = stmt;
+  return result;
+
+failed:
+  //
+  // an error in a breakpoint condition (message already output)
+  // stops at the breakpoint rather than failing the program:
+  //
+  if (condition_stmt != NULL) {
+    ip = condition_stmt;
+    goto stopped;
+  }
+
+  vm_flush(vm, memory, r);
+  result.Success = false;
+  result.LastStmt = stmt;
+  return result;
+}
+
+struct ExecuteResult vm_execute(struct VM_PROGRAM* vm, struct RAM* memory)
+{
+  int next;
+
+  return vm_run(vm, memory, 0, -1, NULL, 0, &next);
+}
+
+//
+// returns the index of stmt, trying the statement the last call
+// stopped at before falling back to the hash table:
+//
+static int vm_stmt_index(VM_PROGRAM* vm, STMT* stmt)
+{
+  if (vm->next_index >= 0 && vm->stmts[vm->next_index] == stmt)
+    return vm->next_index;
+
+  return vm->stmt_index.at(stmt);
+}
+
+struct ExecuteResult vm_step(struct VM_PROGRAM* vm, struct RAM* memory, struct STMT* stmt, struct STMT** next)
+{
+  int index = vm_stmt_index(vm, stmt);
+  struct ExecuteResult result = vm_run(vm, memory, vm->stmt_pc[index], 1, NULL, 0, &vm->next_index);
+
+  *next = (vm->next_index < 0) ? NULL : vm->stmts[vm->next_index];
+  return result;
+}
+
+struct ExecuteResult vm_continue(struct VM_PROGRAM* vm, struct RAM* memory, struct STMT* stmt,
+                                 const unsigned char* stop_lines, int num_lines, struct STMT** next)
+{
+  int index = vm_stmt_index(vm, stmt);
+  struct ExecuteResult result = vm_run(vm, memory, vm->stmt_pc[index], -1, stop_lines, num_lines, &vm->next_index);
+
+  *next = (vm->next_index < 0) ? NULL : vm->stmts[vm->next_index];
+  return result;
+}
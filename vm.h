@@ -0,0 +1,150 @@
+/*vm.h*/
+
+//
+// Bytecode compiler and virtual machine for nuPython, an alternative
+// to executing the program graph directly with execute(). The graph is
+// lowered once into a flat array of instructions whose operands are
+// registers, variable slots and pre-decoded constants, so running the
+// program does no name lookups, no atoi/atof and no mallocs for the
+// values it computes, other than for strings of 16 characters or
+// more, which are shared ropes (see rope.h) rather than copies.
+//
+// Output, error messages and the contents of memory are identical to
+// execute() for every program the VM accepts, except where execute()
+// can't evaluate an expression: the VM evaluates "in" on two strings
+// (a substring search), which execute() reports as invalid operand
+// types, and unary + and - on ints and reals, on which execute()
+// aborts.
+//
+
+#pragma once
+
+#include "programgraph.h"
+#include "ram.h"
+#include "execute.h"
+#include "journal.h"
+#include "infer.h"
+
+
+struct VM_PROGRAM;  // opaque, see vm.cpp
+
+
+//
+// Public functions:
+//
+
+//
+// vm_compile
+//
+// Given a nuPython program graph, compiles the program into
+// bytecode and returns it. Returns NULL if the program uses
+// a construct the VM does not handle (e.g. pointers); in that
+// case the program should be executed with execute().
+//
+// If inference is not NULL (see infer.h), binary operations whose
+// operand types it proved are compiled without type checks. It is
+// only used during the call.
+//
+// NOTE: the bytecode refers to strings inside the program
+// graph, so the graph must outlive the returned program.
+// Call vm_destroy() to free the bytecode.
+//
+struct VM_PROGRAM* vm_compile(struct STMT* program, struct INFERENCE* inference);
+
+//
+// vm_destroy
+//
+// Frees the memory associated with the compiled program.
+//
+void vm_destroy(struct VM_PROGRAM* vm);
+
+//
+// vm_execute
+//
+// Executes the compiled program from the beginning, using the
+// given memory. Same contract as execute(): if a semantic error
+// occurs, an error message is output, execution stops, and
+// {false, pointer to statement where the error occurred} is
+// returned. Otherwise {true, pointer to last stmt executed} is
+// returned.
+//
+struct ExecuteResult vm_execute(struct VM_PROGRAM* vm, struct RAM* memory);
+
+//
+// vm_step
+//
+// Executes exactly one statement of the compiled program, the
+// given stmt (which must be a statement of the program that was
+// compiled). Stepping a while loop evaluates its condition once.
+// On return, *next is the statement that executes next, or NULL
+// if the program has completed. Returns the same way as
+// vm_execute().
+//
+struct ExecuteResult vm_step(struct VM_PROGRAM* vm, struct RAM* memory, struct STMT* stmt, struct STMT** next);
+
+//
+// vm_continue
+//
+// Executes the compiled program starting with the given stmt, and
+// keeps going until the next statement to execute is on a line
+// flagged in stop_lines (stop_lines[line] != 0, for lines less
+// than num_lines), or the program completes. The given stmt itself
+// is always executed, so a breakpoint can be continued from. On
+// return, *next is the statement that executes next, or NULL if
+// the program has completed. Returns the same way as vm_execute().
+//
+struct ExecuteResult vm_continue(struct VM_PROGRAM* vm, struct RAM* memory, struct STMT* stmt,
+                                 const unsigned char* stop_lines, int num_lines, struct STMT** next);
+
+//
+// vm_set_condition
+//
+// Makes the breakpoint on the given line conditional: vm_continue()
+// evaluates expr when it reaches a flagged line that has a condition,
+// and only stops there if the value is true (or if evaluating it
+// fails, after the error message is output). Passing NULL removes the
+// condition. Returns false if the VM cannot evaluate expr, in which
+// case the line has no condition in the VM and every stop there is
+// reported to the caller.
+//
+// NOTE: expr is copied, it does not need to outlive the VM.
+//
+bool vm_set_condition(struct VM_PROGRAM* vm, int line, struct EXPR* expr);
+
+//
+// vm_watch
+//
+// Watches (or stops watching) the variable with the given name:
+// vm_continue() stops right after any statement that writes to a
+// watched variable, whether or not the value changed, with *next
+// the statement after it and the returned LastStmt the statement
+// that did the write. Writes to variables that are not watched
+// cost nothing extra.
+//
+void vm_watch(struct VM_PROGRAM* vm, char* name, bool watched);
+
+//
+// vm_set_journal
+//
+// Records every statement the VM executes from now on, and the old
+// value of every cell it writes, into the given journal (NULL to
+// stop recording). See journal.h.
+//
+void vm_set_journal(struct VM_PROGRAM* vm, struct JOURNAL* journal);
+
+//
+// vm_cell_removed
+//
+// Tells the VM the cell at addr was removed from memory (undoing
+// the write that created it), so it no longer uses that address.
+//
+void vm_cell_removed(struct VM_PROGRAM* vm, int addr);
+
+//
+// vm_memory_reset
+//
+// Tells the VM memory was replaced as a whole (e.g. loaded from a
+// snapshot), so it forgets every address it has looked up, and
+// checks the operand types inference proved from now on.
+//
+void vm_memory_reset(struct VM_PROGRAM* vm);